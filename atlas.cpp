@@ -0,0 +1,243 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ * packing of many small surfaces into a few texture pages
+ */
+
+#define SDLPP_PRIVATE
+#include "sdlpp.hpp"
+#include <climits>
+
+using namespace std;
+
+namespace sdlpp {
+
+TextureAtlas::Page::Page(Renderer& r, int w, int h, PixelFormat format)
+    : texture(r.spawnStatic(w, h, format)), pixels(w, h, format)
+{
+    Node n = { 0, 0, w };
+    skyline.push_back(n);
+}
+
+TextureAtlas::TextureAtlas(Renderer& r, int pw, int ph, int pad,
+                           PixelFormat f)
+    : renderer(r), pageWidth(pw), pageHeight(ph), padding(pad), format(f),
+      blendMode(BlendMode::Blend), liveArea(0)
+{
+    if (SDL_BYTESPERPIXEL(f) != 4) {
+        throw error::RuntimeError("atlas format has no 4 byte pixel");
+    }
+    if (pw <= 0 || ph <= 0 || pad < 0) {
+        throw error::RuntimeError("bad atlas page " + to_string(pw) + "x" +
+                to_string(ph) + " with padding " + to_string(pad));
+    }
+}
+
+TextureAtlas::Entry& TextureAtlas::entry(AtlasRegion region)
+{
+    if (region.id >= entries.size() || !entries[region.id].live) {
+        throw error::RuntimeError("unknown atlas region " +
+                                  to_string(region.id));
+    }
+    return entries[region.id];
+}
+
+const TextureAtlas::Entry& TextureAtlas::entry(AtlasRegion region) const
+{
+    return const_cast<TextureAtlas*>(this)->entry(region);
+}
+
+bool TextureAtlas::fit(vector<Node>& skyline, int w, int h, int width,
+                       int height, Position *pos)
+{
+    // lowest top edge first, then the narrowest node to waste less
+    size_t best = skyline.size();
+    int bestY = INT_MAX, bestW = INT_MAX;
+    for (size_t i = 0; i < skyline.size(); i++) {
+        if (skyline[i].x + w > width) break;
+        int y = 0;
+        for (size_t j = i; j < skyline.size() &&
+                skyline[j].x < skyline[i].x + w; j++) {
+            y = max(y, skyline[j].y);
+        }
+        if (y + h > height) continue;
+        if (y < bestY || (y == bestY && skyline[i].w < bestW)) {
+            best = i;
+            bestY = y;
+            bestW = skyline[i].w;
+        }
+    }
+    if (best == skyline.size()) return false;
+
+    Node n = { skyline[best].x, bestY + h, w };
+    skyline.insert(skyline.begin() + best, n);
+    // cut away what the new node covers
+    for (size_t i = best + 1; i < skyline.size(); ) {
+        int end = skyline[i - 1].x + skyline[i - 1].w;
+        if (skyline[i].x >= end) break;
+        int shrink = end - skyline[i].x;
+        skyline[i].x += shrink;
+        skyline[i].w -= shrink;
+        if (skyline[i].w > 0) break;
+        skyline.erase(skyline.begin() + i);
+    }
+    for (size_t i = 0; i + 1 < skyline.size(); ) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].w += skyline[i + 1].w;
+            skyline.erase(skyline.begin() + i + 1);
+        } else {
+            i++;
+        }
+    }
+    pos->x = n.x;
+    pos->y = bestY;
+    return true;
+}
+
+TextureAtlas::Page& TextureAtlas::newPage()
+{
+    book.push_back(unique_ptr<Page>(
+                new Page(renderer, pageWidth, pageHeight, format)));
+    Page& p = *book.back();
+    p.texture.setBlendMode(blendMode);
+    return p;
+}
+
+int TextureAtlas::place(int w, int h, Position *pos)
+{
+    // the padding may hang over the page edge
+    int pw = min(w + padding, pageWidth), ph = min(h + padding, pageHeight);
+    if (w > pageWidth || h > pageHeight) throw TooLarge();
+    for (size_t i = 0; i < book.size(); i++) {
+        if (fit(book[i]->skyline, pw, ph, pageWidth, pageHeight, pos)) {
+            return i;
+        }
+    }
+    fit(newPage().skyline, pw, ph, pageWidth, pageHeight, pos);
+    return book.size() - 1;
+}
+
+namespace {
+    void upload(Texture& t, Bpp4Surface& pixels, const Rectangle& r)
+    {
+        if (SDL_UpdateTexture(t.get(), &r, pixels.row(r.y) + r.x,
+                    pixels.get()->pitch) < 0) {
+            throw error::RuntimeError("atlas page upload failed");
+        }
+    }
+}
+
+AtlasRegion TextureAtlas::insert(Surface& s)
+{
+    Surface converted = s.convert(format);
+    int w = converted.width(), h = converted.height();
+    size_t pages = book.size();
+    Position pos;
+    int page = place(w, h, &pos);
+    Page& p = *book[page];
+    {
+        SurfaceLock lock(converted);
+        auto src = lock.rows<uint32_t>().begin();
+        for (int y = 0; y < h; y++, ++src) {
+            memcpy(p.pixels.row(pos.y + y) + pos.x, (*src).begin(),
+                   w * sizeof(uint32_t));
+        }
+    }
+    // a new page also needs its empty pixels, which padding relies on
+    Rectangle r(w, h, pos);
+    upload(p.texture, p.pixels, book.size() > pages
+            ? Rectangle(pageWidth, pageHeight, Position(0, 0)) : r);
+
+    Entry e = { page, r, true };
+    AtlasRegion region;
+    if (freeIds.empty()) {
+        region.id = entries.size();
+        entries.push_back(e);
+    } else {
+        region.id = freeIds.back();
+        freeIds.pop_back();
+        entries[region.id] = e;
+    }
+    liveArea += (size_t)w * h;
+    return region;
+}
+
+void TextureAtlas::erase(AtlasRegion region)
+{
+    Entry& e = entry(region);
+    e.live = false;
+    liveArea -= (size_t)e.rect.w * e.rect.h;
+    freeIds.push_back(region.id);
+}
+
+void TextureAtlas::repack()
+{
+    vector<uint32_t> order;
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        if (entries[i].live) order.push_back(i);
+    }
+    stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        const Rectangle& ra = entries[a].rect;
+        const Rectangle& rb = entries[b].rect;
+        return ra.h != rb.h ? ra.h > rb.h : ra.w > rb.w;
+    });
+
+    vector<unique_ptr<Page>> old;
+    old.swap(book);
+    for (auto id : order) {
+        Entry& e = entries[id];
+        Position pos;
+        int page = place(e.rect.w, e.rect.h, &pos);
+        Bpp4Surface& from = old[e.page]->pixels;
+        Bpp4Surface& to = book[page]->pixels;
+        for (int y = 0; y < e.rect.h; y++) {
+            memcpy(to.row(pos.y + y) + pos.x, from.row(e.rect.y + y) + e.rect.x,
+                   e.rect.w * sizeof(uint32_t));
+        }
+        e.page = page;
+        e.rect.x = pos.x;
+        e.rect.y = pos.y;
+    }
+    Rectangle whole(pageWidth, pageHeight, Position(0, 0));
+    for (auto& p : book) {
+        upload(p->texture, p->pixels, whole);
+    }
+}
+
+double TextureAtlas::occupancy() const
+{
+    if (book.empty()) return 0;
+    return (double)liveArea / ((double)book.size() * pageWidth * pageHeight);
+}
+
+void TextureAtlas::setBlendMode(BlendMode::type m)
+{
+    blendMode = m;
+    for (auto& p : book) {
+        p->texture.setBlendMode(m);
+    }
+}
+
+} // end namespace sdlpp
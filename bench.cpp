@@ -0,0 +1,241 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ * micro benchmarks of the raster, blit, texture and event paths
+ */
+
+/*
+ * Runs under the dummy video driver with the software renderer, so the
+ * numbers compare builds rather than GPUs. Each benchmark repeats until
+ * it has run for a while and prints one JSON object per line:
+ *
+ *   {"bench":"canvas.fill_rect","iterations":4096,"ns_per_op":...,
+ *    "items_per_op":65536,"items_per_s":...}
+ *
+ * usage: sdlpp_bench [filter] [seconds per benchmark]
+ */
+
+#define SDL_MAIN_HANDLED 1
+#include "sdlpp.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace sdlpp;
+using namespace std;
+
+namespace {
+    const int W = 1024, H = 1024;
+
+    const char *filter = "";
+    double minSeconds = 0.25;
+
+    double seconds(uint64_t ticks)
+    {
+        return (double)ticks / SDL_GetPerformanceFrequency();
+    }
+
+    //! time run(), which handles items things (pixels, events...) a call
+    void bench(const char *name, double items, const function<void()>& run)
+    {
+        if (!strstr(name, filter)) {
+            return;
+        }
+        run();  // warm up caches and lazy initialization
+        uint64_t iterations = 1, ticks;
+        for (;;) {
+            uint64_t start = SDL_GetPerformanceCounter();
+            for (uint64_t i = 0; i < iterations; i++) {
+                run();
+            }
+            ticks = SDL_GetPerformanceCounter() - start;
+            if (seconds(ticks) >= minSeconds || iterations >= (1u << 30)) {
+                break;
+            }
+            iterations *= 2;
+        }
+        double op = seconds(ticks) / iterations;
+        cout << "{\"bench\":\"" << name << "\",\"iterations\":" << iterations
+             << ",\"ns_per_op\":" << op * 1e9 << ",\"items_per_op\":" << items
+             << ",\"items_per_s\":" << items / op << "}" << endl;
+    }
+
+    void canvas()
+    {
+        Bpp4Surface s(W, H, SDL_PIXELFORMAT_ARGB8888);
+        s.setDrawColor(Color::Blue);
+        bench("canvas.line", 64, [&]() {
+            for (int i = 0; i < 64; i++) {
+                s.drawLine(Position(0, i * 16), Position(W - 1, H - 1 - i * 16));
+            }
+        });
+        bench("canvas.line_aa", 64, [&]() {
+            for (int i = 0; i < 64; i++) {
+                s.drawLineAA(Position(0, i * 16), Position(W - 1, H - 1 - i * 16));
+            }
+        });
+        bench("canvas.circle", 1, [&]() {
+            s.drawCircle(Position(W / 2, H / 2), 400);
+        });
+        bench("canvas.fill_circle", 1, [&]() {
+            s.fillCircle(Position(W / 2, H / 2), 400);
+        });
+        bench("canvas.ellipse", 1, [&]() {
+            s.drawEllipse(Position(W / 2, H / 2), Position(450, 250));
+        });
+        bench("canvas.fill_ellipse", 1, [&]() {
+            s.fillEllipse(Position(W / 2, H / 2), Position(450, 250));
+        });
+        // items are pixels from here on
+        Rectangle area(256, 256, Position(100, 100));
+        bench("canvas.fill_rect", 256 * 256, [&]() {
+            s.fillRectangle(area);
+        });
+        s.setDrawColor(Color(255, 0, 0, 128));
+        s.setBlendMode(BlendMode::Blend);
+        bench("canvas.blend_rect", 256 * 256, [&]() {
+            s.fillRectangle(area);
+        });
+    }
+
+    void surface()
+    {
+        Bpp4Surface dest(W, H, SDL_PIXELFORMAT_ARGB8888);
+        Bpp4Surface src(256, 256, SDL_PIXELFORMAT_ARGB8888);
+        Position at(100, 100);
+        bench("surface.blit", 256 * 256, [&]() {
+            dest.blit(src, nullptr, &at);
+        });
+        Rectangle scaled(512, 512, Position(0, 0));
+        bench("surface.blit_scaled", 512 * 512, [&]() {
+            Rectangle r = scaled;
+            dest.blitScaled(src, nullptr, &r);
+        });
+        bench("surface.convert_abgr", W * H, [&]() {
+            dest.convert(SDL_PIXELFORMAT_ABGR8888);
+        });
+        bench("surface.convert_rgb565", W * H, [&]() {
+            dest.convert(SDL_PIXELFORMAT_RGB565);
+        });
+    }
+
+    void texture(Renderer& renderer)
+    {
+        Bpp4Surface image(64, 64, SDL_PIXELFORMAT_ARGB8888);
+        Texture sprite(renderer, image);
+        bench("renderer.copy", 256, [&]() {
+            for (int i = 0; i < 256; i++) {
+                Rectangle to(64, 64, Position(i * 37 % 576, i * 53 % 416));
+                renderer.copy(sprite, nullptr, &to);
+            }
+        });
+        RenderBatch batch(renderer);
+        bench("renderer.batch_copy", 256, [&]() {
+            for (int i = 0; i < 256; i++) {
+                Rectangle to(64, 64, Position(i * 37 % 576, i * 53 % 416));
+                batch.copy(sprite, nullptr, &to);
+            }
+            batch.flush();
+        });
+        renderer.setDrawColor(Color::Green);
+        bench("renderer.fill_rect", 256, [&]() {
+            for (int i = 0; i < 256; i++) {
+                renderer.fillRectangle(Rectangle(32, 32,
+                            Position(i * 37 % 608, i * 53 % 448)));
+            }
+        });
+        Bpp4Surface big(256, 256, SDL_PIXELFORMAT_ARGB8888);
+        bench("texture.create", 1, [&]() {
+            Texture t(renderer, big);
+        });
+        auto streaming = renderer.spawnStreaming(256, 256,
+                                                 SDL_PIXELFORMAT_ARGB8888);
+        bench("texture.update", 256 * 256, [&]() {
+            streaming.update(big);
+        });
+    }
+
+    void push(int n)
+    {
+        SDL_Event e;
+        SDL_zero(e);
+        e.type = SDL_USEREVENT;
+        for (int i = 0; i < n; i++) {
+            e.user.code = i;
+            SDL_PushEvent(&e);
+        }
+    }
+
+    void events()
+    {
+        using namespace event;
+        const int n = 64;
+        EventData data;
+        // includes SDL_PushEvent(), which is the same for all of them
+        bench("event.poll", n, [&]() {
+            push(n);
+            while (poll(data)) {}
+        });
+        uint32_t kinds = 0;
+        bench("event.slice", n, [&]() {
+            push(n);
+            while (poll(data)) {
+                EventHandler copy = data.slice();
+                kinds |= copy.get()->type;
+            }
+        });
+        EventBatch<n> batch;
+        bench("event.drain", n, [&]() {
+            push(n);
+            batch.drain();
+        });
+        bench("event.poll_empty", 1, [&]() {
+            poll(data);
+        });
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1) filter = argv[1];
+    if (argc > 2 && atof(argv[2]) > 0) minSeconds = atof(argv[2]);
+
+    // the environment variables still win over these
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+    auto sdl = Initializer().video().events().acquire();
+    auto window = sdl.createWindow("sdlpp_bench",
+                                   Rectangle(640, 480, Position(0, 0)),
+                                   WindowMode().hide());
+    Renderer renderer(window.getRenderer());
+
+    cout << "{\"suite\":\"sdlpp\",\"sdl\":\"" << SDL_MAJOR_VERSION << "."
+         << SDL_MINOR_VERSION << "." << SDL_PATCHLEVEL << "\"}" << endl;
+    canvas();
+    surface();
+    texture(renderer);
+    events();
+    return 0;
+}
@@ -24,6 +24,7 @@
  */
 
 #include "common.hpp"
+#include "scene.hpp"
 #include <iostream>
 
 using namespace sdlpp;
@@ -53,36 +54,7 @@ int main(int argc, char *argv[])
      * rendering pixel boundaries
      */
     Bpp4Surface network(dest.width(), dest.height(), format);
-    network.setDrawColor(Color::Blue);
-    for (auto i = 0; i < 600; i+=60) {
-        network.drawLine(Position(0, i), Position(599, i));
-        network.drawLine(Position(i, 0), Position(i, 599));
-    }
-
-    network.setDrawColor(Color::Red);
-    network.drawLine(Position(599, 0), Position(0, 419));
-
-    network.setDrawColor(Color::Black);
-    network.drawEllipse(Position(200, 100), Position(100, 50));
-    network.drawPoint(Position(200, 100)); // ellipse center
-    network.drawLine(Position(200, 50), Position(200, 150)); // horizontal
-    network.drawLine(Position(100, 100), Position(300, 100)); // vertical
-
-    network.setDrawColor(Color::Magenta);
-    network.drawCircle(Position(400, 400), 150);
-
-    Rectangle bound(100, 200, Position(300, 300));
-    network.setDrawColor(Color::Olive);
-    network.drawEllipse(bound);
-    network.drawRectangle(bound);
-
-
-    network.setDrawColor(Color::Purple);
-    network.fillCircle(Position(200, 150), 75);
-
-    bound = Rectangle(100, 200, Position(400, 200));
-    network.setDrawColor(Color::Yellow);
-    network.fillEllipse(bound);
+    drawCanvasScene(network);
 
     dest.blitScaled(canvas);
     dest.blit(network);
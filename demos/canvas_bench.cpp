@@ -0,0 +1,100 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * times the scene of the canvas demo on a 4K Bpp4Surface, drawn directly
+ * and through a TiledCanvas with 1, 2, 4 and 8 worker threads
+ *
+ * usage: canvas_bench [frames]
+ */
+
+#include "sdlpp.hpp"
+#include "scene.hpp"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+using namespace sdlpp;
+using namespace std;
+
+namespace {
+    const int W = 3840, H = 2160;
+
+    //! the canvas demo scene at W x H on a white background
+    template<typename C>
+    void scene(C& c)
+    {
+        c.setDrawColor(Color::White);
+        c.clear();
+        drawCanvasScene(c, W, H);
+    }
+
+    double seconds(chrono::steady_clock::duration d)
+    {
+        return chrono::duration_cast<chrono::duration<double>>(d).count();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 20;
+    if (frames <= 0) frames = 20;
+
+    Bpp4Surface reference(W, H, SDL_PIXELFORMAT_ARGB8888);
+    auto start = chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) {
+        scene(reference);
+    }
+    double direct = seconds(chrono::steady_clock::now() - start) / frames;
+
+    cout << "threads  ms/frame  speedup" << endl;
+    cout << "direct   " << setw(8) << fixed << setprecision(3)
+         << direct * 1000 << "  " << setw(7) << 1.0 << endl;
+
+    const unsigned threads[] = { 1, 2, 4, 8 };
+    for (auto n : threads) {
+        Bpp4Surface surface(W, H, SDL_PIXELFORMAT_ARGB8888);
+        ThreadPool pool(n);
+        TiledCanvas canvas(surface, pool);
+        start = chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++) {
+            scene(canvas);
+            canvas.flush();
+        }
+        double t = seconds(chrono::steady_clock::now() - start) / frames;
+
+        bool same = true;
+        for (int y = 0; y < H && same; y++) {
+            same = !memcmp(
+                static_cast<char*>(surface.pixels()) + y * surface.pitch(),
+                static_cast<char*>(reference.pixels()) + y * reference.pitch(),
+                W * 4);
+        }
+        cout << setw(7) << n << "  " << setw(8) << t * 1000 << "  "
+             << setw(7) << direct / t << (same ? "" : "  (MISMATCH)") << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SDLPP_DEMOS_SCENE_HPP
+#define SDLPP_DEMOS_SCENE_HPP
+
+#include "sdlpp.hpp"
+
+//! the scene of the canvas demo, designed for 600x600 and scaled to
+//! width x height, on any Canvas or TiledCanvas
+template<typename C>
+void drawCanvasScene(C& c, int width = 600, int height = 600)
+{
+    using sdlpp::Color;
+    using sdlpp::Position;
+    using sdlpp::Rectangle;
+    auto p = [=](int x, int y) {
+        return Position(x * width / 600, y * height / 600);
+    };
+
+    c.setDrawColor(Color::Blue);
+    for (auto i = 0; i < 600; i+=60) {
+        c.drawLine(p(0, i), p(599, i));
+        c.drawLine(p(i, 0), p(i, 599));
+    }
+
+    c.setDrawColor(Color::Red);
+    c.drawLine(p(599, 0), p(0, 419));
+
+    c.setDrawColor(Color::Black);
+    c.drawEllipse(p(200, 100), p(100, 50));
+    c.drawPoint(p(200, 100)); // ellipse center
+    c.drawLine(p(200, 50), p(200, 150)); // horizontal
+    c.drawLine(p(100, 100), p(300, 100)); // vertical
+
+    c.setDrawColor(Color::Magenta);
+    c.drawCircle(p(400, 400), 150 * height / 600);
+
+    Position size = p(100, 200);
+    Rectangle bound(size.x, size.y, p(300, 300));
+    c.setDrawColor(Color::Olive);
+    c.drawEllipse(bound);
+    c.drawRectangle(bound);
+
+    c.setDrawColor(Color::Purple);
+    c.fillCircle(p(200, 150), 75 * height / 600);
+
+    bound = Rectangle(size.x, size.y, p(400, 200));
+    c.setDrawColor(Color::Yellow);
+    c.fillEllipse(bound);
+}
+
+#endif
@@ -0,0 +1,358 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ * scalar, SSE2 and AVX2 versions of the pixel kernels
+ */
+
+#define SDLPP_PRIVATE
+#include "sdlpp.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SDLPP_KERNEL_X86 1
+#define SDLPP_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SDLPP_KERNEL_X86 1
+#define SDLPP_TARGET(isa)
+#endif
+
+#ifdef SDLPP_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace sdlpp {
+namespace kernel {
+
+namespace scalar {
+
+    void fill(uint32_t *dst, size_t n, uint32_t value)
+    {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = value;
+        }
+    }
+
+    void colorKey(uint32_t *p, size_t n, uint32_t key, uint32_t amask)
+    {
+        for (size_t i = 0; i < n; i++) {
+            if ((p[i] & ~amask) == key) {
+                p[i] &= ~amask;
+            }
+        }
+    }
+
+    void swapRB(uint32_t *dst, const uint32_t *src, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t v = src[i];
+            uint32_t rb = v & 0x00ff00ff;
+            dst[i] = (v & 0xff00ff00) | (rb << 16) | (rb >> 16);
+        }
+    }
+
+    void blend(uint32_t *p, size_t n, uint32_t src, uint8_t alpha)
+    {
+        for (size_t i = 0; i < n; i++) {
+            p[i] = PixelBlend<BlendMode::Blend>::apply(p[i], src, alpha);
+        }
+    }
+
+    void add(uint32_t *p, size_t n, uint32_t src, uint8_t alpha)
+    {
+        for (size_t i = 0; i < n; i++) {
+            p[i] = PixelBlend<BlendMode::Add>::apply(p[i], src, alpha);
+        }
+    }
+
+    void mod(uint32_t *p, size_t n, uint32_t src, uint8_t alpha)
+    {
+        for (size_t i = 0; i < n; i++) {
+            p[i] = PixelBlend<BlendMode::Mod>::apply(p[i], src, alpha);
+        }
+    }
+
+    const Table table = { fill, colorKey, swapRB, blend, add, mod };
+}
+
+#ifdef SDLPP_KERNEL_X86
+namespace sse2 {
+
+    SDLPP_TARGET("sse2")
+    void fill(uint32_t *dst, size_t n, uint32_t value)
+    {
+        __m128i v = _mm_set1_epi32((int)value);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_si128((__m128i*)(dst + i), v);
+        }
+        scalar::fill(dst + i, n - i, value);
+    }
+
+    SDLPP_TARGET("sse2")
+    void colorKey(uint32_t *p, size_t n, uint32_t key, uint32_t amask)
+    {
+        __m128i k = _mm_set1_epi32((int)key);
+        __m128i a = _mm_set1_epi32((int)amask);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+            __m128i hit = _mm_cmpeq_epi32(_mm_andnot_si128(a, v), k);
+            v = _mm_andnot_si128(_mm_and_si128(hit, a), v);
+            _mm_storeu_si128((__m128i*)(p + i), v);
+        }
+        scalar::colorKey(p + i, n - i, key, amask);
+    }
+
+    SDLPP_TARGET("sse2")
+    void swapRB(uint32_t *dst, const uint32_t *src, size_t n)
+    {
+        __m128i agmask = _mm_set1_epi32((int)0xff00ff00);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i rb = _mm_andnot_si128(agmask, v);
+            v = _mm_or_si128(_mm_and_si128(v, agmask),
+                    _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16)));
+            _mm_storeu_si128((__m128i*)(dst + i), v);
+        }
+        scalar::swapRB(dst + i, src + i, n - i);
+    }
+
+    // div255() of every 16 bit lane holding a product of two bytes
+    SDLPP_TARGET("sse2")
+    inline __m128i div255(__m128i v)
+    {
+        v = _mm_add_epi16(v, _mm_set1_epi16(0x80));
+        return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+    }
+
+    SDLPP_TARGET("sse2")
+    void blend(uint32_t *p, size_t n, uint32_t src, uint8_t alpha)
+    {
+        // channels 0 and 2 in the low, 1 and 3 in the high byte of lanes
+        __m128i lo = _mm_set1_epi16(0xff);
+        __m128i inv = _mm_set1_epi16(0xff - alpha);
+        __m128i s = _mm_set1_epi32((int)src);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+            __m128i rb = div255(_mm_mullo_epi16(_mm_and_si128(v, lo), inv));
+            __m128i ag = div255(_mm_mullo_epi16(_mm_srli_epi16(v, 8), inv));
+            v = _mm_add_epi32(s, _mm_or_si128(rb, _mm_slli_epi16(ag, 8)));
+            _mm_storeu_si128((__m128i*)(p + i), v);
+        }
+        scalar::blend(p + i, n - i, src, alpha);
+    }
+
+    SDLPP_TARGET("sse2")
+    void add(uint32_t *p, size_t n, uint32_t src, uint8_t alpha)
+    {
+        __m128i s = _mm_set1_epi32((int)src);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+            _mm_storeu_si128((__m128i*)(p + i), _mm_adds_epu8(v, s));
+        }
+        scalar::add(p + i, n - i, src, alpha);
+    }
+
+    SDLPP_TARGET("sse2")
+    void mod(uint32_t *p, size_t n, uint32_t src, uint8_t alpha)
+    {
+        __m128i zero = _mm_setzero_si128();
+        __m128i s = _mm_unpacklo_epi8(_mm_set1_epi32((int)src), zero);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+            __m128i l = div255(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), s));
+            __m128i h = div255(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), s));
+            _mm_storeu_si128((__m128i*)(p + i), _mm_packus_epi16(l, h));
+        }
+        scalar::mod(p + i, n - i, src, alpha);
+    }
+
+    const Table table = { fill, colorKey, swapRB, blend, add, mod };
+}
+
+namespace avx2 {
+
+    SDLPP_TARGET("avx2")
+    void fill(uint32_t *dst, size_t n, uint32_t value)
+    {
+        __m256i v = _mm256_set1_epi32((int)value);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_si256((__m256i*)(dst + i), v);
+        }
+        scalar::fill(dst + i, n - i, value);
+    }
+
+    SDLPP_TARGET("avx2")
+    void colorKey(uint32_t *p, size_t n, uint32_t key, uint32_t amask)
+    {
+        __m256i k = _mm256_set1_epi32((int)key);
+        __m256i a = _mm256_set1_epi32((int)amask);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+            __m256i hit = _mm256_cmpeq_epi32(_mm256_andnot_si256(a, v), k);
+            v = _mm256_andnot_si256(_mm256_and_si256(hit, a), v);
+            _mm256_storeu_si256((__m256i*)(p + i), v);
+        }
+        scalar::colorKey(p + i, n - i, key, amask);
+    }
+
+    SDLPP_TARGET("avx2")
+    void swapRB(uint32_t *dst, const uint32_t *src, size_t n)
+    {
+        __m256i agmask = _mm256_set1_epi32((int)0xff00ff00);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+            __m256i rb = _mm256_andnot_si256(agmask, v);
+            v = _mm256_or_si256(_mm256_and_si256(v, agmask),
+                    _mm256_or_si256(_mm256_slli_epi32(rb, 16),
+                                    _mm256_srli_epi32(rb, 16)));
+            _mm256_storeu_si256((__m256i*)(dst + i), v);
+        }
+        scalar::swapRB(dst + i, src + i, n - i);
+    }
+
+    SDLPP_TARGET("avx2")
+    inline __m256i div255(__m256i v)
+    {
+        v = _mm256_add_epi16(v, _mm256_set1_epi16(0x80));
+        return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)),
+                                 8);
+    }
+
+    SDLPP_TARGET("avx2")
+    void blend(uint32_t *p, size_t n, uint32_t src, uint8_t alpha)
+    {
+        __m256i lo = _mm256_set1_epi16(0xff);
+        __m256i inv = _mm256_set1_epi16(0xff - alpha);
+        __m256i s = _mm256_set1_epi32((int)src);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+            __m256i rb = div255(_mm256_mullo_epi16(_mm256_and_si256(v, lo),
+                                                   inv));
+            __m256i ag = div255(_mm256_mullo_epi16(_mm256_srli_epi16(v, 8),
+                                                   inv));
+            v = _mm256_add_epi32(s, _mm256_or_si256(rb,
+                                                    _mm256_slli_epi16(ag, 8)));
+            _mm256_storeu_si256((__m256i*)(p + i), v);
+        }
+        scalar::blend(p + i, n - i, src, alpha);
+    }
+
+    SDLPP_TARGET("avx2")
+    void add(uint32_t *p, size_t n, uint32_t src, uint8_t alpha)
+    {
+        __m256i s = _mm256_set1_epi32((int)src);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+            _mm256_storeu_si256((__m256i*)(p + i), _mm256_adds_epu8(v, s));
+        }
+        scalar::add(p + i, n - i, src, alpha);
+    }
+
+    SDLPP_TARGET("avx2")
+    void mod(uint32_t *p, size_t n, uint32_t src, uint8_t alpha)
+    {
+        // unpacking and packing both work per 128 bit half, so the pixel
+        // order is kept
+        __m256i zero = _mm256_setzero_si256();
+        __m256i s = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)src), zero);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+            __m256i l = div255(_mm256_mullo_epi16(
+                        _mm256_unpacklo_epi8(v, zero), s));
+            __m256i h = div255(_mm256_mullo_epi16(
+                        _mm256_unpackhi_epi8(v, zero), s));
+            _mm256_storeu_si256((__m256i*)(p + i), _mm256_packus_epi16(l, h));
+        }
+        scalar::mod(p + i, n - i, src, alpha);
+    }
+
+    const Table table = { fill, colorKey, swapRB, blend, add, mod };
+}
+#endif
+
+bool supported(Isa::type isa)
+{
+    switch (isa) {
+        case Isa::Scalar:
+            return true;
+#ifdef SDLPP_KERNEL_X86
+        case Isa::SSE2:
+            return SDL_HasSSE2() == SDL_TRUE;
+#if SDL_VERSION_ATLEAST(2, 0, 4)
+        case Isa::AVX2:
+            return SDL_HasAVX2() == SDL_TRUE;
+#endif
+#endif
+        default:
+            return false;
+    }
+}
+
+const Table& table(Isa::type isa)
+{
+    switch (isa) {
+#ifdef SDLPP_KERNEL_X86
+        case Isa::AVX2:
+            return avx2::table;
+        case Isa::SSE2:
+            return sse2::table;
+#endif
+        default:
+            return scalar::table;
+    }
+}
+
+const Table& best()
+{
+    static const Table& t = supported(Isa::AVX2) ? table(Isa::AVX2)
+                          : supported(Isa::SSE2) ? table(Isa::SSE2)
+                          : table(Isa::Scalar);
+    return t;
+}
+
+// constant initialized, so spans drawn before the dynamic initialization
+// below, e.g. by other static constructors, still find a table
+const Table *current = &scalar::table;
+
+namespace {
+    struct Select {
+        Select() { current = &best(); }
+    } select;
+}
+
+} // end namespace kernel
+} // end namespace sdlpp
@@ -0,0 +1,121 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ * image decoding on a ThreadPool
+ */
+
+#define SDLPP_PRIVATE
+#include "sdlpp.hpp"
+
+using namespace std;
+
+namespace sdlpp {
+
+ImageLoader::ImageLoader(ThreadPool& p, PixelFormat f)
+    : pool(p), format(f), shared(make_shared<Shared>()), loading(0)
+{
+    // the decoders initialize lazily, which is not thread safe
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+}
+
+Surface ImageLoader::read(const string& path, PixelFormat format)
+{
+    SDLPP_ZONE("ImageLoader::read");
+    Surface s = Surface::loadIMG(path);
+    if (format == SDL_PIXELFORMAT_UNKNOWN || s.format() == format) {
+        return s;
+    }
+    return s.convert(format);
+}
+
+future<Surface> ImageLoader::decode(const string& path)
+{
+    auto promise = make_shared<std::promise<Surface>>();
+    PixelFormat f = format;
+    pool.post([promise, path, f]() {
+        try {
+            promise->set_value(read(path, f));
+        } catch (...) {
+            promise->set_exception(current_exception());
+        }
+    });
+    return promise->get_future();
+}
+
+void ImageLoader::load(const string& path, OnSurface done, OnError failed)
+{
+    auto to = shared;
+    PixelFormat f = format;
+    pool.post([to, path, f, done, failed]() {
+        Decoded d;
+        try {
+            d.surface.reset(new Surface(read(path, f)));
+        } catch (...) {
+            // reported by dispatch() through failed
+        }
+        d.path = path;
+        d.done = done;
+        d.failed = failed;
+        lock_guard<mutex> hold(to->lock);
+        to->ready.push_back(move(d));
+    });
+    loading++;
+}
+
+void ImageLoader::load(const string& path, Renderer& r, OnTexture done,
+                       OnError failed)
+{
+    Renderer *renderer = &r;
+    load(path, [renderer, done](Surface& s) {
+        Texture t(*renderer, s);
+        done(t);
+    }, failed);
+}
+
+size_t ImageLoader::dispatch(chrono::microseconds budget)
+{
+    auto start = chrono::steady_clock::now();
+    size_t n = 0;
+    for (;;) {
+        Decoded d;
+        {
+            lock_guard<mutex> hold(shared->lock);
+            if (shared->ready.empty()) break;
+            d = move(shared->ready.front());
+            shared->ready.pop_front();
+        }
+        loading--;
+        n++;
+        if (d.surface) {
+            d.done(*d.surface);
+        } else if (d.failed) {
+            d.failed(d.path);
+        }
+        if (chrono::steady_clock::now() - start >= budget) break;
+    }
+    return n;
+}
+
+} // end namespace sdlpp
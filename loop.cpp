@@ -0,0 +1,156 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ * fixed timestep main loop with frame pacing
+ */
+
+#define SDLPP_PRIVATE
+#include "sdlpp.hpp"
+
+using namespace std;
+
+namespace sdlpp {
+
+FrameLoop::FrameLoop(Input in, Update up, Render re, double updateRate,
+                     double frameRate, unsigned maxUp)
+    : input(in), update(up), render(re),
+      frequency(SDL_GetPerformanceFrequency()),
+      step(frequency / updateRate), period(0), maxUpdates(maxUp),
+      running(false), started(false), origin(0), last(0), accumulator(0),
+      deadline(0), margin(frequency / 1000.0)
+{
+    if (updateRate <= 0) {
+        throw error::RuntimeError("update rate " + to_string(updateRate) +
+                                  " is not positive");
+    }
+    if (maxUp == 0) {
+        throw error::RuntimeError("no update allowed per frame");
+    }
+    if (!update || !render) {
+        throw error::RuntimeError("frame loop without update or render");
+    }
+    setFrameRate(frameRate);
+    resetStats();
+}
+
+void FrameLoop::setFrameRate(double hz)
+{
+    period = hz > 0 ? frequency / hz : 0;
+}
+
+void FrameLoop::resetStats()
+{
+    Stats zero = {};
+    counters = zero;
+}
+
+void FrameLoop::run()
+{
+    running = true;
+    while (running) {
+        frame();
+    }
+}
+
+void FrameLoop::frame()
+{
+    uint64_t now = SDL_GetPerformanceCounter();
+    if (!started) {
+        started = true;
+        last = origin = now;
+        deadline = 0;
+    }
+    double seconds = (double)(now - last) / frequency;
+    accumulator += (double)(now - last);
+    last = now;
+    if (counters.frames > 0) {
+        counters.last = seconds;
+        counters.average = counters.frames == 1 ? seconds
+            : counters.average + (seconds - counters.average) / 16;
+        counters.worst = max(counters.worst, seconds);
+    }
+    counters.frames++;
+
+    if (input) {
+        SDLPP_ZONE("FrameLoop::input");
+        input();
+    }
+    double dt = step / frequency;
+    unsigned n = 0;
+    for (; accumulator >= step && n < maxUpdates; n++) {
+        SDLPP_ZONE("FrameLoop::update");
+        update(dt);
+        accumulator -= step;
+    }
+    counters.updates += n;
+    if (accumulator >= step) {
+        uint64_t behind = (uint64_t)(accumulator / step);
+        counters.droppedUpdates += behind;
+        accumulator -= behind * step;
+    }
+    {
+        SDLPP_ZONE("FrameLoop::render");
+        render(accumulator / step);
+    }
+#ifdef SDLPP_PROFILE
+    profile::frame();
+#endif
+    SDLPP_ZONE("FrameLoop::pace");
+    pace();
+}
+
+double FrameLoop::elapsed() const
+{
+    return (double)(SDL_GetPerformanceCounter() - origin);
+}
+
+void FrameLoop::pace()
+{
+    if (period <= 0) return;
+    deadline += period;
+    double now = elapsed();
+    if (deadline < now - period) {
+        // a long stall, do not rush frames to catch up
+        deadline = now;
+        return;
+    }
+    double wait = deadline - now - margin;
+    if (wait > 0) {
+        uint32_t ms = (uint32_t)(wait * 1000 / frequency);
+        if (ms > 0) {
+            double before = elapsed();
+            SDL_Delay(ms);
+            double slept = elapsed() - before;
+            double over = slept - ms * (frequency / 1000.0);
+            // grow at once after an oversleep, shrink slowly
+            margin = over > margin ? over : margin - (margin - over) / 16;
+            margin = max(margin, frequency / 10000.0);
+        }
+    }
+    while (elapsed() < deadline) {
+    }
+}
+
+} // end namespace sdlpp
@@ -0,0 +1,133 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ * headless rendering into a surface and PNG encoding
+ */
+
+#define SDLPP_PRIVATE
+#include "sdlpp.hpp"
+
+using namespace std;
+
+namespace sdlpp {
+
+namespace {
+
+// a write only SDL_RWops appending to a vector, enough for the encoders
+vector<uint8_t>& buffer(SDL_RWops *rw)
+{
+    return *static_cast<vector<uint8_t>*>(rw->hidden.unknown.data1);
+}
+
+Sint64 bufferSize(SDL_RWops *rw)
+{
+    return buffer(rw).size();
+}
+
+Sint64 bufferSeek(SDL_RWops *rw, Sint64 offset, int whence)
+{
+    // only asking for the position, which is always the end
+    Sint64 end = buffer(rw).size();
+    if ((whence == RW_SEEK_SET && offset == end) ||
+            (whence != RW_SEEK_SET && offset == 0)) {
+        return end;
+    }
+    SDL_SetError("seek in a PNG buffer");
+    return -1;
+}
+
+size_t bufferRead(SDL_RWops *, void *, size_t, size_t)
+{
+    return 0;
+}
+
+size_t bufferWrite(SDL_RWops *rw, const void *p, size_t size, size_t num)
+{
+    auto bytes = static_cast<const uint8_t*>(p);
+    buffer(rw).insert(buffer(rw).end(), bytes, bytes + size * num);
+    return num;
+}
+
+int bufferClose(SDL_RWops *rw)
+{
+    SDL_FreeRW(rw);
+    return 0;
+}
+
+} // end anonymous namespace
+
+OffscreenTarget::OffscreenTarget(int width, int height, PixelFormat format)
+    : surface(width, height, format),
+      render(SDL_CreateSoftwareRenderer(surface.get()))
+{
+    if (!render.get()) {
+        THROW_SDLPP_RUNTIME_ERROR();
+    }
+}
+
+void OffscreenTarget::flush()
+{
+#if SDL_VERSION_ATLEAST(2, 0, 10)
+    if (SDL_RenderFlush(render.get()) < 0) {
+        THROW_SDLPP_RUNTIME_ERROR();
+    }
+#endif
+}
+
+void OffscreenTarget::encodePNG(vector<uint8_t>& out)
+{
+    flush();
+    out.clear();
+    SDL_RWops *rw = SDL_AllocRW();
+    if (!rw) {
+        THROW_SDLPP_RUNTIME_ERROR();
+    }
+    rw->size = bufferSize;
+    rw->seek = bufferSeek;
+    rw->read = bufferRead;
+    rw->write = bufferWrite;
+    rw->close = bufferClose;
+    rw->hidden.unknown.data1 = &out;
+    if (IMG_SavePNG_RW(surface.get(), rw, 1) < 0) {
+        throw EncodeFailure(error::getmsg());
+    }
+}
+
+vector<uint8_t> OffscreenTarget::encodePNG()
+{
+    vector<uint8_t> out;
+    encodePNG(out);
+    return out;
+}
+
+void OffscreenTarget::savePNG(const string& path)
+{
+    flush();
+    if (IMG_SavePNG(surface.get(), path.c_str()) < 0) {
+        throw EncodeFailure(error::getmsg());
+    }
+}
+
+} // end namespace sdlpp
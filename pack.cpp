@@ -0,0 +1,371 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ * memory mapped files, pack files and the converted surface cache
+ */
+
+#define SDLPP_PRIVATE
+#include "sdlpp.hpp"
+#include <fstream>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace sdlpp {
+
+#ifdef _WIN32
+MappedFile::MappedFile(const string& path, Mode::type mode)
+    : bytes(nullptr), length(0)
+{
+    bool copy = mode == Mode::CopyOnWrite;
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) throw OpenFailure(path);
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f, &size)) {
+        CloseHandle(f);
+        throw OpenFailure(path);
+    }
+    length = (size_t)size.QuadPart;
+    if (length) {
+        // the view keeps the mapping alive
+        HANDLE m = CreateFileMappingA(f, nullptr,
+                copy ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+        bytes = m ? MapViewOfFile(m, copy ? FILE_MAP_COPY : FILE_MAP_READ,
+                                  0, 0, 0) : nullptr;
+        if (m) CloseHandle(m);
+    }
+    CloseHandle(f);
+    if (length && !bytes) throw OpenFailure(path);
+}
+
+MappedFile::~MappedFile()
+{
+    if (bytes) UnmapViewOfFile(bytes);
+}
+#else
+MappedFile::MappedFile(const string& path, Mode::type mode)
+    : bytes(nullptr), length(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw OpenFailure(path);
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw OpenFailure(path);
+    }
+    length = (size_t)st.st_size;
+    if (length) {
+        // the mapping stays valid after the descriptor is closed
+        void *p = mode == Mode::CopyOnWrite
+            ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+            : mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        bytes = p == MAP_FAILED ? nullptr : p;
+    }
+    close(fd);
+    if (length && !bytes) throw OpenFailure(path);
+}
+
+MappedFile::~MappedFile()
+{
+    if (bytes) munmap(const_cast<void*>(bytes), length);
+}
+#endif
+
+MappedFile::MappedFile(MappedFile&& f) : bytes(f.bytes), length(f.length)
+{
+    f.bytes = nullptr;
+    f.length = 0;
+}
+
+MemoryRegion MappedFile::region() const
+{
+    MemoryRegion r = { bytes, length };
+    return r;
+}
+
+namespace {
+    const char packMagic[8] = { 'S', 'D', 'L', 'P', 'P', 'P', 'K', '1' };
+    const size_t packAlign = 16;
+
+    //! reads little endian integers, checking the bounds
+    struct Reader {
+        const uint8_t *p, *end;
+        bool take(size_t n) { return (size_t)(end - p) >= n; }
+        uint64_t number(int bytes) {
+            if (!take(bytes)) throw PackFile::FormatError();
+            uint64_t v = 0;
+            for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+            p += bytes;
+            return v;
+        }
+    };
+
+    void putNumber(string& out, uint64_t v, int bytes)
+    {
+        for (int i = 0; i < bytes; i++, v >>= 8) out.push_back((char)(v & 0xff));
+    }
+}
+
+PackFile::PackFile(const string& path) : file(path)
+{
+    MemoryRegion all = file.region();
+    auto base = static_cast<const uint8_t*>(all.data);
+    Reader in = { base, base + all.size };
+    if (!in.take(sizeof(packMagic)) ||
+            memcmp(base, packMagic, sizeof(packMagic)) != 0) {
+        throw FormatError(path);
+    }
+    in.p += sizeof(packMagic);
+    uint32_t count = in.number(4);
+    for (uint32_t i = 0; i < count; i++) {
+        size_t n = in.number(4);
+        if (!in.take(n)) throw FormatError(path);
+        string name(reinterpret_cast<const char*>(in.p), n);
+        in.p += n;
+        uint64_t offset = in.number(8), size = in.number(8);
+        if (offset > all.size || size > all.size - offset) {
+            throw FormatError(path);
+        }
+        MemoryRegion r = { base + offset, (size_t)size };
+        index[name] = r;
+    }
+}
+
+bool PackFile::contains(const string& name) const
+{
+    return index.count(name) != 0;
+}
+
+MemoryRegion PackFile::get(const string& name) const
+{
+    auto i = index.find(name);
+    if (i == index.end()) throw NotFound(name);
+    return i->second;
+}
+
+vector<string> PackFile::names() const
+{
+    vector<string> all;
+    for (auto& i : index) all.push_back(i.first);
+    sort(all.begin(), all.end());
+    return all;
+}
+
+Surface PackFile::loadBMP(const string& name) const
+{
+    return Surface::loadBMP(get(name));
+}
+
+Surface PackFile::loadIMG(const string& name) const
+{
+    return Surface::loadIMG(get(name));
+}
+
+namespace {
+    //! 64 bit hash of the bytes, eight at a time
+    uint64_t hash(MemoryRegion r)
+    {
+        auto p = static_cast<const uint8_t*>(r.data);
+        uint64_t h = 0x9e3779b97f4a7c15ull ^ r.size, v;
+        size_t i = 0;
+        for (; i + 8 <= r.size; i += 8) {
+            memcpy(&v, p + i, 8);
+            h = (h ^ v) * 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+        }
+        v = 0;
+        memcpy(&v, p + i, r.size - i);
+        h = (h ^ v) * 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 33);
+    }
+
+    const char cacheMagic[8] = { 'S', 'D', 'L', 'P', 'P', 'S', 'C', '1' };
+
+    //! a cache file is this header followed by pitch * height bytes
+    struct CacheHeader {
+        char magic[8];
+        uint64_t key;
+        uint64_t encodedSize;
+        uint32_t format, width, height, pitch;
+        char reserved[24];
+    };
+    static_assert(sizeof(CacheHeader) == 64, "pixels start 64 aligned");
+}
+
+CachedSurface::CachedSurface(SDL_Surface *s, unique_ptr<MappedFile> f)
+    : file(move(f)), image(s)
+{
+}
+
+CachedSurface::CachedSurface(Surface&& s) : image(move(s))
+{
+}
+
+CachedSurface::CachedSurface(CachedSurface&& s)
+    : file(move(s.file)), image(move(s.image))
+{
+}
+
+SurfaceCache::SurfaceCache(const string& directory, PixelFormat f)
+    : dir(directory), format(f), hitCount(0), missCount(0)
+{
+}
+
+string SurfaceCache::entry(uint64_t key) const
+{
+    char name[48];
+    snprintf(name, sizeof(name), "/%016llx-%08x.surface",
+             (unsigned long long)key, (unsigned)format);
+    return dir + name;
+}
+
+string SurfaceCache::entry(MemoryRegion encoded) const
+{
+    return entry(hash(encoded));
+}
+
+CachedSurface SurfaceCache::load(const string& path)
+{
+    MappedFile encoded(path);
+    return load(encoded.region());
+}
+
+CachedSurface SurfaceCache::load(MemoryRegion encoded)
+{
+    uint64_t key = hash(encoded);
+    string name = entry(key);
+    try {
+        unique_ptr<MappedFile> f(
+                new MappedFile(name, MappedFile::Mode::CopyOnWrite));
+        MemoryRegion r = f->region();
+        CacheHeader h;
+        if (r.size >= sizeof(h)) {
+            memcpy(&h, r.data, sizeof(h));
+        }
+        int bpp;
+        uint32_t rm, gm, bm, am;
+        if (r.size >= sizeof(h) &&
+                memcmp(h.magic, cacheMagic, sizeof(cacheMagic)) == 0 &&
+                h.key == key && h.encodedSize == encoded.size &&
+                h.format == (uint32_t)format &&
+                h.pitch >= h.width * SDL_BYTESPERPIXEL(format) &&
+                h.pitch > 0 && (r.size - sizeof(h)) / h.pitch >= h.height &&
+                SDL_PixelFormatEnumToMasks(format, &bpp, &rm, &gm, &bm, &am)) {
+            // copy on write, so the surface may be drawn on
+            void *pixels = const_cast<uint8_t*>(
+                    static_cast<const uint8_t*>(r.data) + sizeof(h));
+            SDL_Surface *s = SDL_CreateRGBSurfaceFrom(pixels, h.width,
+                    h.height, bpp, h.pitch, rm, gm, bm, am);
+            if (s) {
+                hitCount++;
+                return CachedSurface(s, move(f));
+            }
+        }
+    } catch (const MappedFile::OpenFailure&) {
+    }
+
+    missCount++;
+    Surface decoded = Surface::loadIMG(encoded);
+    Surface s = decoded.format() == format ? move(decoded)
+                                           : decoded.convert(format);
+    {
+        SurfaceLock lock(s);
+        CacheHeader h = {};
+        memcpy(h.magic, cacheMagic, sizeof(cacheMagic));
+        h.key = key;
+        h.encodedSize = encoded.size;
+        h.format = format;
+        h.width = s.width();
+        h.height = s.height();
+        h.pitch = s.get()->pitch;
+        // written aside and renamed, so readers never see half a file
+        string tmp = name + ".tmp";
+        ofstream out(tmp.c_str(), ios::binary | ios::trunc);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(static_cast<const char*>(lock.pixels()),
+                  (streamsize)h.pitch * h.height);
+        out.close();
+        if (!out || std::rename(tmp.c_str(), name.c_str()) != 0) {
+            std::remove(tmp.c_str());
+        }
+    }
+    return CachedSurface(move(s));
+}
+
+void PackWriter::add(const string& name, MemoryRegion data)
+{
+    auto p = static_cast<const char*>(data.data);
+    files.push_back(make_pair(name, string(p, p + data.size)));
+}
+
+void PackWriter::addFile(const string& name, const string& path)
+{
+    MappedFile f(path);
+    add(name, f.region());
+}
+
+void PackWriter::write(const string& path) const
+{
+    string header(packMagic, sizeof(packMagic));
+    putNumber(header, files.size(), 4);
+    size_t size = header.size();
+    for (auto& f : files) {
+        size += 4 + f.first.size() + 8 + 8;
+    }
+    uint64_t offset = (size + packAlign - 1) / packAlign * packAlign;
+    for (auto& f : files) {
+        putNumber(header, f.first.size(), 4);
+        header += f.first;
+        putNumber(header, offset, 8);
+        putNumber(header, f.second.size(), 8);
+        offset += (f.second.size() + packAlign - 1) / packAlign * packAlign;
+    }
+
+    ofstream out(path.c_str(), ios::binary | ios::trunc);
+    const string pad(packAlign, '\0');
+    out.write(header.data(), header.size());
+    out.write(pad.data(), (packAlign - header.size() % packAlign) % packAlign);
+    for (auto& f : files) {
+        out.write(f.second.data(), f.second.size());
+        out.write(pad.data(), (packAlign - f.second.size() % packAlign) % packAlign);
+    }
+    if (!out.flush()) {
+        throw error::RuntimeError("can not write pack file " + path);
+    }
+}
+
+} // end namespace sdlpp
@@ -0,0 +1,142 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ * pools recycling surfaces and textures by size and format
+ */
+
+#define SDLPP_PRIVATE
+#include "sdlpp.hpp"
+
+using namespace std;
+
+namespace sdlpp {
+
+bool PoolKey::operator==(const PoolKey& k) const
+{
+    return width == k.width && height == k.height && format == k.format &&
+           access == k.access;
+}
+
+size_t PoolKey::bytes() const
+{
+    return (size_t)width * height * SDL_BYTESPERPIXEL(format);
+}
+
+size_t PoolKeyHash::operator()(const PoolKey& k) const
+{
+    size_t h = k.width;
+    h = h * 31 + k.height;
+    h = h * 31 + k.format;
+    return h * 31 + k.access;
+}
+
+SurfacePool::SurfacePool(size_t capacity)
+    : ObjectPool<Surface>(capacity)
+{
+}
+
+void SurfacePool::reset(Surface& s)
+{
+    SDL_Surface *p = s.get();
+    s.trackDirty(nullptr);
+    SDL_SetClipRect(p, nullptr);
+    SDL_SetColorKey(p, SDL_FALSE, 0);
+    // blitting state as SDL_CreateRGBSurface() sets it
+    SDL_SetSurfaceBlendMode(p, p->format->Amask ? SDL_BLENDMODE_BLEND
+                                                : SDL_BLENDMODE_NONE);
+    SDL_SetSurfaceAlphaMod(p, 0xff);
+    SDL_SetSurfaceColorMod(p, 0xff, 0xff, 0xff);
+}
+
+PoolHandle<Surface> SurfacePool::acquire(int width, int height,
+                                         PixelFormat format)
+{
+    PoolKey k = { width, height, format, Plain };
+    auto s = ObjectPool<Surface>::acquire<Surface>(k, [&]() {
+        return new Surface(width, height, format);
+    });
+    reset(*s);
+    return s;
+}
+
+PoolHandle<Bpp4Surface, Surface> SurfacePool::acquireBpp4(int width,
+        int height, PixelFormat format)
+{
+    PoolKey k = { width, height, format, Bpp4 };
+    auto s = ObjectPool<Surface>::acquire<Bpp4Surface>(k, [&]() {
+        return new Bpp4Surface(width, height, format);
+    });
+    reset(*s);
+    // as Canvas() sets them
+    s->trackDirty(nullptr);
+    s->setClipRect(nullptr);
+    s->setBlendMode(BlendMode::None);
+    s->setDrawColor(Color(0, 0, 0, 0));
+    return s;
+}
+
+TexturePool::TexturePool(Renderer& r, size_t capacity)
+    : ObjectPool<Texture>(capacity), renderer(r)
+{
+}
+
+template<typename U>
+PoolHandle<U, Texture> TexturePool::take(int width, int height,
+        PixelFormat format, SDL_TextureAccess access)
+{
+    PoolKey k = { width, height, format, access };
+    Renderer& r = renderer;
+    auto t = ObjectPool<Texture>::acquire<U>(k, [&]() {
+        return new U(r.createTexture<U>(format, access, width, height));
+    });
+    // the setters skip what is already set
+    t->setColorMod(Color::White);
+    t->setAlphaMod(255);
+    t->setBlendMode(BlendMode::None);
+    return t;
+}
+
+PoolHandle<TargetTexture, Texture> TexturePool::acquireTarget(int width,
+        int height, PixelFormat format)
+{
+    return take<TargetTexture>(width, height, format,
+                               SDL_TEXTUREACCESS_TARGET);
+}
+
+PoolHandle<StaticTexture, Texture> TexturePool::acquireStatic(int width,
+        int height, PixelFormat format)
+{
+    return take<StaticTexture>(width, height, format,
+                               SDL_TEXTUREACCESS_STATIC);
+}
+
+PoolHandle<StreamingTexture, Texture> TexturePool::acquireStreaming(int width,
+        int height, PixelFormat format)
+{
+    return take<StreamingTexture>(width, height, format,
+                                  SDL_TEXTUREACCESS_STREAMING);
+}
+
+} // end namespace sdlpp
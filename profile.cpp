@@ -0,0 +1,257 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ * opt-in profiling zones, frame counters and Chrome trace export
+ */
+
+#define SDLPP_PRIVATE
+#include "sdlpp.hpp"
+#include <fstream>
+
+using namespace std;
+
+namespace sdlpp {
+namespace profile {
+
+namespace {
+
+struct ZoneRecord {
+    const char *name;
+    uint64_t begin, end;
+    unsigned tid;
+};
+
+// written by its own thread only, head is published after the slot;
+// counts only grow, frame() and clear() remember what they have seen
+struct Ring {
+    vector<ZoneRecord> slots;
+    atomic<uint64_t> head;
+    atomic<uint64_t> counts[Counter::count];
+    unsigned tid;   //!< of the thread owning the ring now
+    const void *lastTexture;
+    // keeps the counts of two threads off one cache line
+    char pad[64];
+    Ring(unsigned id)
+        : slots(ringSize), head(0), tid(id), lastTexture(nullptr) {
+        for (auto& c : counts) {
+            c.store(0, memory_order_relaxed);
+        }
+    }
+};
+
+struct FrameRecord {
+    uint64_t time;
+    uint64_t values[Counter::count];
+};
+
+const char *counterNames[Counter::count] = {
+    "drawCalls", "textureSwitches", "pixelsFilled", "blits", "allocations"
+};
+
+// taken when a thread takes or returns its ring and by frame() and export
+mutex registry;
+// rings outlive their threads, so zones of finished workers are kept
+// until a new thread taking the ring over from spare overwrites them
+vector<unique_ptr<Ring>> rings;
+vector<Ring*> spare;
+unsigned threads;
+deque<FrameRecord> frames;
+// the sums of all ring counts at the last frame() or clear()
+uint64_t seen[Counter::count];
+
+// hands the ring of a finished thread to the next thread
+struct Owner {
+    Ring *ring;
+    Owner() : ring(nullptr) {}
+    ~Owner() {
+        if (ring) {
+            lock_guard<mutex> hold(registry);
+            spare.push_back(ring);
+        }
+    }
+};
+
+Ring& local()
+{
+    static thread_local Owner owner;
+    if (!owner.ring) {
+        lock_guard<mutex> hold(registry);
+        if (spare.empty()) {
+            rings.emplace_back(new Ring(++threads));
+            owner.ring = rings.back().get();
+        } else {
+            owner.ring = spare.back();
+            owner.ring->tid = ++threads;
+            owner.ring->lastTexture = nullptr;
+            spare.pop_back();
+        }
+    }
+    return *owner.ring;
+}
+
+// sum of every ring's count c, registry must be held
+uint64_t total(size_t c)
+{
+    uint64_t n = 0;
+    for (auto& r : rings) {
+        n += r->counts[c].load(memory_order_relaxed);
+    }
+    return n;
+}
+
+void writeString(ostream& out, const char *s)
+{
+    out << '"';
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            out << '\\' << *s;
+        } else if ((unsigned char)*s < 0x20) {
+            out << ' ';
+        } else {
+            out << *s;
+        }
+    }
+    out << '"';
+}
+
+} // end anonymous namespace
+
+uint64_t now()
+{
+    return SDL_GetPerformanceCounter();
+}
+
+void record(const char *name, uint64_t begin, uint64_t end)
+{
+    Ring& r = local();
+    uint64_t h = r.head.load(memory_order_relaxed);
+    ZoneRecord z = { name, begin, end, r.tid };
+    r.slots[h % ringSize] = z;
+    r.head.store(h + 1, memory_order_release);
+}
+
+void count(Counter::type c, uint64_t n)
+{
+    // only this thread writes, so no locked read-modify-write is needed
+    atomic<uint64_t>& v = local().counts[c];
+    v.store(v.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+void texture(const void *t)
+{
+    Ring& r = local();
+    if (r.lastTexture != t) {
+        r.lastTexture = t;
+        count(Counter::TextureSwitches, 1);
+    }
+}
+
+void frame()
+{
+    FrameRecord f;
+    f.time = now();
+    lock_guard<mutex> hold(registry);
+    for (size_t i = 0; i < Counter::count; i++) {
+        uint64_t n = total(i);
+        f.values[i] = n - seen[i];
+        seen[i] = n;
+    }
+    frames.push_back(f);
+    if (frames.size() > ringSize) {
+        frames.pop_front();
+    }
+}
+
+void clear()
+{
+    lock_guard<mutex> hold(registry);
+    for (auto& r : rings) {
+        r->head.store(0, memory_order_release);
+        r->lastTexture = nullptr;
+    }
+    frames.clear();
+    for (size_t i = 0; i < Counter::count; i++) {
+        seen[i] = total(i);
+    }
+}
+
+void writeChromeTrace(ostream& out)
+{
+    lock_guard<mutex> hold(registry);
+
+    // timestamps are microseconds since the oldest record
+    uint64_t base = UINT64_MAX;
+    for (auto& r : rings) {
+        uint64_t h = r->head.load(memory_order_acquire);
+        for (uint64_t i = h > ringSize ? h - ringSize : 0; i < h; i++) {
+            base = min(base, r->slots[i % ringSize].begin);
+        }
+    }
+    for (auto& f : frames) {
+        base = min(base, f.time);
+    }
+    const double us = 1e6 / SDL_GetPerformanceFrequency();
+
+    out << "{\"traceEvents\":[";
+    const char *sep = "\n";
+    out.setf(ios::fixed);
+    out.precision(3);
+    for (auto& r : rings) {
+        uint64_t h = r->head.load(memory_order_acquire);
+        for (uint64_t i = h > ringSize ? h - ringSize : 0; i < h; i++) {
+            const ZoneRecord& z = r->slots[i % ringSize];
+            out << sep << "{\"name\":";
+            writeString(out, z.name);
+            out << ",\"ph\":\"X\",\"ts\":" << (z.begin - base) * us
+                << ",\"dur\":" << (z.end - z.begin) * us
+                << ",\"pid\":1,\"tid\":" << z.tid << "}";
+            sep = ",\n";
+        }
+    }
+    for (auto& f : frames) {
+        out << sep << "{\"name\":\"sdlpp\",\"ph\":\"C\",\"ts\":"
+            << (f.time - base) * us << ",\"pid\":1,\"args\":{";
+        for (size_t i = 0; i < Counter::count; i++) {
+            out << (i ? "," : "") << '"' << counterNames[i] << "\":"
+                << f.values[i];
+        }
+        out << "}}";
+        sep = ",\n";
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+bool writeChromeTrace(const string& path)
+{
+    ofstream out(path.c_str());
+    if (!out) {
+        return false;
+    }
+    writeChromeTrace(out);
+    return (bool)out.flush();
+}
+
+} // end namespace profile
+} // end namespace sdlpp
@@ -28,6 +28,8 @@
 #include <iostream>
 #include <functional>
 #include <cstring>
+#include <algorithm>
+#include <climits>
 
 using namespace std;
 
@@ -79,40 +81,436 @@ Surface::loadIMG(const std::string& path)
     return Surface(p);
 }
 
+namespace {
+    // SDL_RWFromConstMem() takes an int size
+    int memSize(MemoryRegion data)
+    {
+        if (data.size > INT_MAX) {
+            throw error::RuntimeError("image of " +
+                    std::to_string(data.size) + " bytes is too large to load");
+        }
+        return (int)data.size;
+    }
+}
+
+Surface
+Surface::loadBMP(MemoryRegion data)
+{
+    auto p = SDL_LoadBMP_RW(SDL_RWFromConstMem(data.data, memSize(data)), 1);
+    if (!p) {
+        throw LoadFailure();
+    }
+    return Surface(p);
+}
+
+Surface
+Surface::loadIMG(MemoryRegion data)
+{
+    auto p = IMG_Load_RW(SDL_RWFromConstMem(data.data, memSize(data)), 1);
+    if (!p) {
+        throw LoadFailure();
+    }
+    return Surface(p);
+}
+
 void
 Surface::blit(const Surface& src,
               const Rectangle* srcrect,
         const Position* destpos)
 {
-    SDL_Rect tmp;
+    SDL_Rect tmp = { 0, 0, 0, 0 };
     if (destpos) {
         tmp.x = destpos->x;
         tmp.y = destpos->y;
     }
 
-    if (SDL_BlitSurface(src.ptr, srcrect, ptr,
-                destpos == nullptr ? nullptr : &tmp) != 0) {
+    SDLPP_COUNT(Blits, 1);
+    // tmp is set to the clipped destination rectangle
+    if (SDL_BlitSurface(src.ptr, srcrect, ptr, &tmp) != 0) {
         throw BlitFailure();
     }
+    if (dirty) {
+        dirty->add(Rectangle(tmp.w, tmp.h, Position(tmp.x, tmp.y)));
+    }
 }
 
 void
 Surface::blitScaled(const Surface& src, Rectangle* srcrect,
                     Rectangle* destrect)
 {
+    Rectangle area = destrect ? *destrect
+                              : Rectangle(width(), height(), Position(0, 0));
+    SDLPP_COUNT(Blits, 1);
     if (SDL_BlitScaled( src.ptr, srcrect, ptr, destrect) != 0) {
         throw BlitFailure();
     }
+    if (dirty) {
+        int x0 = max(area.x, 0), y0 = max(area.y, 0);
+        int x1 = min(area.x + area.w, width());
+        int y1 = min(area.y + area.h, height());
+        dirty->add(Rectangle(x1 - x0, y1 - y0, Position(x0, y0)));
+    }
+}
+
+Surface
+Surface::convert(PixelFormat format)
+{
+    PixelFormat from = this->format();
+    std::uint32_t key;
+    bool swap = (from == SDL_PIXELFORMAT_ARGB8888 &&
+                 format == SDL_PIXELFORMAT_ABGR8888) ||
+                (from == SDL_PIXELFORMAT_ABGR8888 &&
+                 format == SDL_PIXELFORMAT_ARGB8888);
+    if (!swap || SDL_MUSTLOCK(ptr) || SDL_GetColorKey(ptr, &key) == 0) {
+        SDL_Surface *newsuf = SDL_ConvertSurfaceFormat(ptr, format, 0);
+        if (!newsuf) throw ConvertFailure();
+        SDLPP_COUNT(Allocations, 1);
+        return Surface(newsuf);
+    }
+
+    Surface dest(width(), height(), format);
+    auto swapRB = kernel::best().swapRB;
+    auto src = rows<std::uint32_t>();
+    auto to = dest.rows<std::uint32_t>().begin();
+    for (auto row : src) {
+        swapRB((*to).begin(), row.begin(), row.size());
+        ++to;
+    }
+    // keep the blit state like SDL_ConvertSurface() does
+    SDL_BlendMode mode;
+    std::uint8_t r, g, b, a;
+    SDL_GetSurfaceBlendMode(ptr, &mode);
+    SDL_GetSurfaceAlphaMod(ptr, &a);
+    SDL_GetSurfaceColorMod(ptr, &r, &g, &b);
+    SDL_SetSurfaceBlendMode(dest.ptr, mode);
+    SDL_SetSurfaceAlphaMod(dest.ptr, a);
+    SDL_SetSurfaceColorMod(dest.ptr, r, g, b);
+    return dest;
+}
+
+void
+Surface::keyToAlpha(const Color& c)
+{
+    auto fmt = getFormat();
+    if (fmt->BytesPerPixel != 4 || fmt->Amask == 0) {
+        throw error::RuntimeError("surface has no 4 byte pixel with alpha");
+    }
+
+    SurfaceLock lock(*this);
+    auto colorKey = kernel::best().colorKey;
+    std::uint32_t key = SDL_MapRGB(fmt, c.red, c.green, c.blue) & ~fmt->Amask;
+    for (auto row : lock.rows<std::uint32_t>()) {
+        colorKey(row.begin(), row.size(), key, fmt->Amask);
+    }
+}
+
+void
+Surface::setPalette(const Color *colors, int n, int first)
+{
+    SDL_Palette *palette = getFormat()->palette;
+    if (!palette) {
+        throw error::RuntimeError("surface has no palette");
+    }
+    std::vector<SDL_Color> entries(n);
+    for (int i = 0; i < n; i++) {
+        SDL_Color c = { colors[i].red, colors[i].green, colors[i].blue,
+                        colors[i].alpha };
+        entries[i] = c;
+    }
+    if (SDL_SetPaletteColors(palette, entries.data(), first, n) < 0) {
+        THROW_SDLPP_RUNTIME_ERROR();
+    }
+}
+
+StreamingTexture::Lock
+StreamingTexture::lock(const Rectangle* rect)
+{
+    std::uint32_t format;
+    int w, h;
+    if (SDL_QueryTexture(ptr, &format, nullptr, &w, &h) < 0) {
+        throw error::RuntimeError("can not query the streaming texture");
+    }
+    if (SDL_BYTESPERPIXEL(format) != 4) {
+        throw error::RuntimeError("streaming texture has no 4 byte pixel");
+    }
+    if (rect) {
+        w = rect->w;
+        h = rect->h;
+    }
+    // SDL shares one SDL_PixelFormat per format, so this only counts
+    // references after the first lock
+    SDL_PixelFormat *f = SDL_AllocFormat(format);
+    void *pixels;
+    int pitch;
+    if (!f || SDL_LockTexture(ptr, rect, &pixels, &pitch) < 0) {
+        SDL_FreeFormat(f);
+        THROW_SDLPP_RUNTIME_ERROR();
+    }
+    return Lock(ptr, f, pixels, w, h, pitch);
+}
+
+void
+StreamingTexture::update(Surface& s, const Rectangle* rect)
+{
+    std::uint32_t format;
+    int w, h;
+    if (SDL_QueryTexture(ptr, &format, nullptr, &w, &h) < 0) {
+        throw error::RuntimeError("can not query the streaming texture");
+    }
+    if (format != s.format() || w != s.width() || h != s.height()) {
+        throw error::RuntimeError("surface of " + std::to_string(s.width()) +
+                "x" + std::to_string(s.height()) + " " +
+                SDL_GetPixelFormatName(s.format()) +
+                " does not match the streaming texture of " +
+                std::to_string(w) + "x" + std::to_string(h) + " " +
+                SDL_GetPixelFormatName(format));
+    }
+    // SDL clips rect to the texture only, the source pixels must be too
+    Rectangle part(w, h, Position(0, 0));
+    if (rect && !SDL_IntersectRect(rect, &part, &part)) return;
+    SurfaceLock lock(s);
+    auto p = static_cast<std::uint8_t*>(lock.pixels());
+    int pitch = s.get()->pitch;
+    p += part.y * pitch + part.x * SDL_BYTESPERPIXEL(format);
+    if (SDL_UpdateTexture(ptr, &part, p, pitch) < 0) {
+        THROW_SDLPP_RUNTIME_ERROR();
+    }
+}
+
+void
+StreamingTexture::update(Surface& s, const DirtyRegion& region)
+{
+    for (auto& r : region.rects()) {
+        update(s, &r);
+    }
 }
 
 void
 Renderer::copy(Texture& texture, const Rectangle* src, const Rectangle* dest)
 {
+    SDLPP_COUNT(DrawCalls, 1);
+    SDLPP_TEXTURE(texture.get());
     if (SDL_RenderCopy(ptr, texture.get(), src, dest)) {
         THROW_SDLPP_RUNTIME_ERROR();
     }
 }
 
+RenderBatch::RenderBatch(Renderer& r, Order::type o)
+    : renderer(r), order(o), color(0x000000ff)
+{
+}
+
+void RenderBatch::setDrawColor(const Color& c)
+{
+    color = ((std::uint32_t)c.red << 24) | (c.green << 16) | (c.blue << 8) |
+            c.alpha;
+}
+
+RenderBatch::Item& RenderBatch::push(Item::Kind kind)
+{
+    Item i = {};
+    i.kind = kind;
+    i.color = kind == Item::Copy ? 0 : color;
+    items.push_back(i);
+    return items.back();
+}
+
+void RenderBatch::drawPoint(Position pos)
+{
+    Item& i = push(Item::Point);
+    i.dest.x = pos.x;
+    i.dest.y = pos.y;
+}
+
+void RenderBatch::drawLine(Position a, Position b)
+{
+    Item& i = push(Item::Line);
+    i.dest.x = a.x; i.dest.y = a.y;
+    i.dest.w = b.x; i.dest.h = b.y;
+}
+
+void RenderBatch::drawRectangle(const Rectangle& rect)
+{
+    push(Item::Rect).dest = rect;
+}
+
+void RenderBatch::fillRectangle(const Rectangle& rect)
+{
+    push(Item::FillRect).dest = rect;
+}
+
+void RenderBatch::copy(Texture& texture, const Rectangle* srcrect,
+                       const Rectangle* destrect)
+{
+    Item& i = push(Item::Copy);
+    i.texture = texture.get();
+    if ((i.hasSrc = srcrect != nullptr)) i.src = *srcrect;
+    if ((i.hasDest = destrect != nullptr)) i.dest = *destrect;
+}
+
+bool RenderBatch::sameRun(const Item& a, const Item& b)
+{
+    return a.kind == b.kind && a.color == b.color && a.texture == b.texture;
+}
+
+size_t RenderBatch::flush()
+{
+    SDLPP_ZONE("RenderBatch::flush");
+    // a failing call drops the whole batch
+    std::vector<Item> todo;
+    todo.swap(items);
+    if (order == Order::State) {
+        std::stable_sort(todo.begin(), todo.end(),
+                [](const Item& a, const Item& b) {
+                    if (a.kind != b.kind) return a.kind < b.kind;
+                    if (a.texture != b.texture) return a.texture < b.texture;
+                    return a.color < b.color;
+                });
+    }
+
+    SDL_Renderer *r = renderer.get();
+    // a polyline draws the vertex two lines share once, which only looks
+    // like two separate lines when pixels are not blended
+    SDL_BlendMode mode;
+    if (SDL_GetRenderDrawBlendMode(r, &mode) < 0) {
+        THROW_SDLPP_RUNTIME_ERROR();
+    }
+    bool join = mode == SDL_BLENDMODE_NONE;
+    size_t calls = 0;
+    std::vector<SDL_Point> points;
+    std::vector<SDL_Rect> rects;
+    for (size_t i = 0, j; i < todo.size(); i = j) {
+        for (j = i + 1; j < todo.size() && sameRun(todo[i], todo[j]); j++) {}
+        const Item *first = &todo[i], *last = first + (j - i);
+
+        // share the color the renderer remembers, both ways, and its stats
+        if (first->kind != Item::Copy) {
+            std::uint32_t c = first->color;
+            std::size_t issued = renderer.stats().issued;
+            renderer.setDrawColor(Color(c >> 24, (c >> 16) & 0xff,
+                                        (c >> 8) & 0xff, c & 0xff));
+            calls += renderer.stats().issued - issued;
+        }
+
+        int err = 0;
+        switch (first->kind) {
+            case Item::Point:
+                points.clear();
+                for (auto p = first; p != last; p++) {
+                    SDL_Point pt = { p->dest.x, p->dest.y };
+                    points.push_back(pt);
+                }
+                calls++;
+                err = SDL_RenderDrawPoints(r, points.data(), points.size());
+                break;
+            case Item::Line:
+                points.clear();
+                for (auto p = first; p != last && !err; p++) {
+                    SDL_Point a = { p->dest.x, p->dest.y };
+                    SDL_Point b = { p->dest.w, p->dest.h };
+                    if (!points.empty() && (!join ||
+                                            points.back().x != a.x ||
+                                            points.back().y != a.y)) {
+                        calls++;
+                        err = SDL_RenderDrawLines(r, points.data(),
+                                                  points.size());
+                        points.clear();
+                    }
+                    if (points.empty()) points.push_back(a);
+                    points.push_back(b);
+                }
+                if (!err) {
+                    calls++;
+                    err = SDL_RenderDrawLines(r, points.data(), points.size());
+                }
+                break;
+            case Item::Rect:
+            case Item::FillRect:
+                rects.clear();
+                for (auto p = first; p != last; p++) {
+                    rects.push_back(p->dest);
+                }
+                calls++;
+                err = first->kind == Item::Rect
+                    ? SDL_RenderDrawRects(r, rects.data(), rects.size())
+                    : SDL_RenderFillRects(r, rects.data(), rects.size());
+                break;
+            case Item::Copy:
+                calls += drawCopies(first, last);
+                break;
+        }
+        if (err < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+    }
+    SDLPP_COUNT(DrawCalls, calls);
+    return calls;
+}
+
+size_t RenderBatch::drawCopies(const Item *first, const Item *last)
+{
+    SDL_Renderer *r = renderer.get();
+    SDL_Texture *t = first->texture;
+    size_t calls = 0;
+    SDLPP_TEXTURE(t);
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    // vertex colors are white, so the texture color and alpha mods must
+    // be neutral for the geometry to look like SDL_RenderCopy()
+    Uint8 mr, mg, mb, ma;
+    int tw = 0, th = 0;
+    bool geometry = SDL_GetTextureColorMod(t, &mr, &mg, &mb) == 0 &&
+                    SDL_GetTextureAlphaMod(t, &ma) == 0 &&
+                    (mr & mg & mb & ma) == 0xff &&
+                    SDL_QueryTexture(t, nullptr, nullptr, &tw, &th) == 0;
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+    auto drawQuads = [&]() {
+        if (vertices.empty()) return;
+        calls++;
+        if (SDL_RenderGeometry(r, t, vertices.data(), vertices.size(),
+                    indices.data(), indices.size()) < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+        vertices.clear();
+        indices.clear();
+    };
+#endif
+    for (auto p = first; p != last; p++) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        SDL_Rect s = p->hasSrc ? p->src : SDL_Rect{ 0, 0, tw, th };
+        // SDL_RenderCopy() clips the source, which geometry can not do
+        if (geometry && p->hasDest && s.x >= 0 && s.y >= 0 &&
+                s.x + s.w <= tw && s.y + s.h <= th) {
+            const SDL_Rect& d = p->dest;
+            float x[2] = { (float)d.x, (float)(d.x + d.w) };
+            float y[2] = { (float)d.y, (float)(d.y + d.h) };
+            float u[2] = { (float)s.x / tw, (float)(s.x + s.w) / tw };
+            float v[2] = { (float)s.y / th, (float)(s.y + s.h) / th };
+            int base = vertices.size();
+            for (int k = 0; k < 4; k++) {
+                SDL_Vertex vx = { { x[k & 1], y[k >> 1] },
+                                  { 0xff, 0xff, 0xff, 0xff },
+                                  { u[k & 1], v[k >> 1] } };
+                vertices.push_back(vx);
+            }
+            const int quad[] = { 0, 1, 2, 1, 3, 2 };
+            for (int k : quad) indices.push_back(base + k);
+            continue;
+        }
+        drawQuads();
+#endif
+        calls++;
+        if (SDL_RenderCopy(r, t, p->hasSrc ? &p->src : nullptr,
+                    p->hasDest ? &p->dest : nullptr) < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+    }
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    drawQuads();
+#endif
+    return calls;
+}
+
 Color::Color(ColorEnum e)
 {
     static Color table[] = {
@@ -136,44 +534,189 @@ Color::Color(ColorEnum e)
     memcpy((void*)this, (void*)&table[e], sizeof(*this));
 }
 
-namespace event {
+namespace {
+    long long area(const Rectangle& r)
+    {
+        return (long long)r.w * r.h;
+    }
+
+    Rectangle unite(const Rectangle& a, const Rectangle& b)
+    {
+        int x0 = min(a.x, b.x), y0 = min(a.y, b.y);
+        int x1 = max(a.x + a.w, b.x + b.w), y1 = max(a.y + a.h, b.y + b.h);
+        return Rectangle(x1 - x0, y1 - y0, Position(x0, y0));
+    }
+
+    //! area covered by a or b
+    long long covered(const Rectangle& a, const Rectangle& b)
+    {
+        int ow = min(a.x + a.w, b.x + b.w) - max(a.x, b.x);
+        int oh = min(a.y + a.h, b.y + b.h) - max(a.y, b.y);
+        long long overlap = ow > 0 && oh > 0 ? (long long)ow * oh : 0;
+        return area(a) + area(b) - overlap;
+    }
 
-    void EventData::initptr()
+    //! area inside the bounding box of a and b but outside both
+    long long waste(const Rectangle& a, const Rectangle& b)
     {
-        if (!ptr) {
-            ptr = std::unique_ptr<SDL_Event>(new SDL_Event());
+        return area(unite(a, b)) - covered(a, b);
+    }
+}
+
+void DirtyRegion::add(const Rectangle& rect)
+{
+    if (rect.w <= 0 || rect.h <= 0) {
+        return;
+    }
+
+    // absorb every rectangle that merges cheaply, which may enable more
+    Rectangle r = rect;
+    for (size_t i = 0; i < list.size(); ) {
+        if (waste(list[i], r) <= covered(list[i], r)) {
+            r = unite(list[i], r);
+            list.erase(list.begin() + i);
+            i = 0;
+        } else {
+            i++;
         }
     }
+    list.push_back(r);
+
+    while (list.size() > capacity) {
+        size_t bi = 0, bj = 1;
+        long long best = waste(list[0], list[1]);
+        for (size_t i = 0; i < list.size(); i++) {
+            for (size_t j = i + 1; j < list.size(); j++) {
+                long long w = waste(list[i], list[j]);
+                if (w < best) {
+                    best = w; bi = i; bj = j;
+                }
+            }
+        }
+        list[bi] = unite(list[bi], list[bj]);
+        list.erase(list.begin() + bj);
+    }
+}
+
+Rectangle DirtyRegion::bounds() const
+{
+    if (list.empty()) {
+        return Rectangle(0, 0, Position(0, 0));
+    }
+    Rectangle r = list[0];
+    for (auto& i : list) {
+        r = unite(r, i);
+    }
+    return r;
+}
+
+ThreadPool::ThreadPool(unsigned threads) : running(0), stopping(false)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+void ThreadPool::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push_back(std::move(task));
+    }
+    wakeup.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [this] { return tasks.empty() && running == 0; });
+}
+
+bool ThreadPool::isWorker() const
+{
+    auto self = std::this_thread::get_id();
+    for (auto& t : workers) {
+        if (t.get_id() == self) return true;
+    }
+    return false;
+}
+
+void ThreadPool::work()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        wakeup.wait(guard, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty()) {
+            return; // stopping and drained
+        }
+        auto task = std::move(tasks.front());
+        tasks.pop_front();
+        running++;
+        guard.unlock();
+        task();
+        guard.lock();
+        if (--running == 0 && tasks.empty()) {
+            idle.notify_all();
+        }
+    }
+}
+
+namespace event {
 
     bool poll(EventData &eh)
     {
-        eh.initptr();
-        return !!SDL_PollEvent(eh.ptr.get());
+        SDLPP_ZONE("event::poll");
+        // an empty queue leaves the previous event in place
+        if (!SDL_PollEvent(&eh.event)) {
+            return false;
+        }
+        eh.valid = true;
+        return true;
     }
 
     void wait(EventData &eh)
     {
-        eh.initptr();
-        SDL_WaitEvent(eh.ptr.get());
+        if (SDL_WaitEvent(&eh.event)) {
+            eh.valid = true;
+        }
     }
 
-    EventHandler EventData::slice()
+    size_t drain(SDL_Event* buffer, size_t capacity)
     {
-        size_t size;
-        switch (ptr->type) {
-            case SDL_WINDOWEVENT:
-                size = sizeof(SDL_WindowEvent);
-                break;
-            case SDL_QUIT:
-                size = sizeof(SDL_CommonEvent);
-                break;
-            default:
-                size = sizeof(*ptr.get());
-                break;
+        SDLPP_ZONE("event::drain");
+        SDL_PumpEvents();
+        int n = SDL_PeepEvents(buffer, (int)capacity, SDL_GETEVENT,
+                               SDL_FIRSTEVENT, SDL_LASTEVENT);
+        if (n < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
         }
-        char *p = new char[size];
-        std::memmove((void*)p, ptr.get(), size);
-        return create((SDL_Event*)p);
+        return n;
+    }
+
+    std::uint32_t messageEventType()
+    {
+        static const std::uint32_t type = SDL_RegisterEvents(1);
+        return type;
+    }
+
+    EventHandler EventData::slice()
+    {
+        return create(*get());
     }
 
 } // end namespace event
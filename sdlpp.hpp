@@ -42,7 +42,21 @@ extern "C" {
 #include <memory>
 #include <type_traits>
 #include <cstdlib>
+#include <cstring>
 #include <stack>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <unordered_map>
+#include <tuple>
+#include <atomic>
 
 namespace sdlpp {
 
@@ -74,6 +88,75 @@ namespace sdlpp {
 #define THROW_SDLPP_RUNTIME_ERROR() (throw sdlpp::error::RuntimeError(std::string(__FILE__) + ":" + std::to_string(TO_NUMBER(__LINE__))))
     }
 
+    //! opt-in instrumentation
+    /*!
+     *  The library is instrumented with SDLPP_ZONE, which times the
+     *  enclosing scope, and SDLPP_COUNT, which adds to a per-frame
+     *  counter. Both expand to nothing unless SDLPP_PROFILE is defined,
+     *  for the library and its users alike (the SDLPP_PROFILE CMake
+     *  option or ./configure --enable-profile).
+     *
+     *  Zones and counts are written without locks into a ring buffer
+     *  owned by the recording thread, frame() sums the counts of all
+     *  rings into a frame and writeChromeTrace() saves what is left in
+     *  the rings as JSON for chrome://tracing or Perfetto. The ring of a
+     *  finished thread is handed to the next new thread. Export and
+     *  clear() while the other threads are not recording, e.g. at exit.
+     */
+    namespace profile {
+        //! closure for keeping inside enum
+        struct Counter {
+            enum type {
+                DrawCalls,          //!< calls into the SDL renderer
+                TextureSwitches,    //!< copies from another texture than the previous one
+                PixelsFilled,       //!< pixels written by software spans
+                Blits,              //!< surface blits
+                Allocations         //!< surfaces and textures created
+            };
+            static const std::size_t count = Allocations + 1;
+        };
+
+        //! zones kept per thread, older ones are overwritten
+        const std::size_t ringSize = 1 << 16;
+
+        //! @return current time in performance counter ticks
+        std::uint64_t now();
+        //! store a zone in the ring of the calling thread
+        void record(const char *name, std::uint64_t begin, std::uint64_t end);
+        void count(Counter::type c, std::uint64_t n);
+        //! count a texture switch when t is not the last texture seen by this thread
+        void texture(const void *t);
+        //! close a frame: the counters are stored and restart from zero
+        void frame();
+        void writeChromeTrace(std::ostream& out);
+        //! @return false when the file can not be written
+        bool writeChromeTrace(const std::string& path);
+        //! forget all zones, frames and counters
+        void clear();
+
+        //! times its own lifetime, name must outlive the trace
+        class Zone {
+            const char *name;
+            std::uint64_t begin;
+        public:
+            explicit Zone(const char *n) : name(n), begin(now()) {}
+            ~Zone() { record(name, begin, now()); }
+            Zone(const Zone&) = delete;
+            Zone& operator=(const Zone&) = delete;
+        };
+    }
+#ifdef SDLPP_PROFILE
+#define SDLPP_PROFILE_CAT2(a, b) a##b
+#define SDLPP_PROFILE_CAT(a, b) SDLPP_PROFILE_CAT2(a, b)
+#define SDLPP_ZONE(name) sdlpp::profile::Zone SDLPP_PROFILE_CAT(sdlppZone, __LINE__)(name)
+#define SDLPP_COUNT(counter, n) sdlpp::profile::count(sdlpp::profile::Counter::counter, (n))
+#define SDLPP_TEXTURE(t) sdlpp::profile::texture(t)
+#else
+#define SDLPP_ZONE(name) ((void)0)
+#define SDLPP_COUNT(counter, n) ((void)0)
+#define SDLPP_TEXTURE(t) ((void)0)
+#endif
+
     //! %Event Processing
     /*!
      */
@@ -91,7 +174,9 @@ namespace sdlpp {
                 MouseWheel,
                 Quit,
                 User,
+                Unknown     //!< any other SDL event
             };
+            static const std::size_t count = Unknown + 1;
         };
 
         //! base class for all Event specifilizations
@@ -110,7 +195,8 @@ namespace sdlpp {
          *  const reference to a Event, the actual data are stored inside
          *  EventHandler. Exceptions will be trigger when trying to access
          *  Event when its underleying data store(EventHandler) is dead, such
-         *  as out of scope.
+         *  as out of scope. The event is stored inside the EventHandler, so
+         *  an Event must not be used after its EventHandler was moved.
          */
         template<EventType::type T>
         class Event;
@@ -147,6 +233,106 @@ namespace sdlpp {
             SDL_Keycode sym() const;
         };
 
+        //! input method composition event
+        template<>
+        class Event<EventType::TextEditing> : protected EventBase<SDL_TextEditingEvent> {
+            Event(PointType p) : EventBase(p) {}
+        public:
+            typedef Event type;
+            static const type extract(const SDL_Event* e);
+
+            //! UTF-8 text being composed
+            const char *text() const;
+            //! cursor position and selection length in the composition
+            int start() const;
+            int length() const;
+        };
+
+        //! mouse motion event
+        template<>
+        class Event<EventType::MouseMotion> : protected EventBase<SDL_MouseMotionEvent> {
+            Event(PointType p) : EventBase(p) {}
+        public:
+            typedef Event type;
+            static const type extract(const SDL_Event* e);
+
+            //! position relative to the window
+            int x() const;
+            int y() const;
+            //! motion since the previous event
+            int xrel() const;
+            int yrel() const;
+            //! SDL_BUTTON_LMASK etc of the buttons held
+            std::uint32_t buttons() const;
+        };
+
+        //! mouse button press or release
+        template<>
+        class Event<EventType::MouseButton> : protected EventBase<SDL_MouseButtonEvent> {
+            Event(PointType p) : EventBase(p) {}
+        public:
+            typedef Event type;
+            static const type extract(const SDL_Event* e);
+
+            //! SDL_BUTTON_LEFT etc
+            std::uint8_t button() const;
+            bool pressed() const;
+            //! 1 for single click, 2 for double click, ...
+            std::uint8_t clicks() const;
+            int x() const;
+            int y() const;
+        };
+
+        //! mouse wheel event
+        template<>
+        class Event<EventType::MouseWheel> : protected EventBase<SDL_MouseWheelEvent> {
+            Event(PointType p) : EventBase(p) {}
+        public:
+            typedef Event type;
+            static const type extract(const SDL_Event* e);
+
+            //! scrolled amount, positive x is right, positive y away from
+            //! the user, already corrected for flipped wheels
+            int x() const;
+            int y() const;
+        };
+
+        //! quit request
+        template<>
+        class Event<EventType::Quit> : protected EventBase<SDL_QuitEvent> {
+            Event(PointType p) : EventBase(p) {}
+        public:
+            typedef Event type;
+            static const type extract(const SDL_Event* e);
+        };
+
+        //! application defined event
+        template<>
+        class Event<EventType::User> : protected EventBase<SDL_UserEvent> {
+            Event(PointType p) : EventBase(p) {}
+        public:
+            typedef Event type;
+            static const type extract(const SDL_Event* e);
+
+            //! the SDL event type, SDL_USEREVENT or one registered later
+            std::uint32_t kind() const;
+            std::int32_t code() const;
+            void *data1() const;
+            void *data2() const;
+        };
+
+        //! any event without a better specialization
+        template<>
+        class Event<EventType::Unknown> : protected EventBase<SDL_CommonEvent> {
+            Event(PointType p) : EventBase(p) {}
+        public:
+            typedef Event type;
+            static const type extract(const SDL_Event* e);
+
+            //! the SDL event type
+            std::uint32_t kind() const;
+        };
+
         class EventData;
 
         //! use this function to poll for currently pending events.
@@ -159,12 +345,94 @@ namespace sdlpp {
         //! like poll, but will block until interesting events happen
         void wait(EventData& eh);
 
+        //! the EventType of a raw SDL event
+        EventType::type typeOf(const SDL_Event& e);
+
+        /*!
+         * pump once and move up to capacity pending events into buffer
+         * with a single SDL_PeepEvents()
+         * @return number of events stored, capacity when more may wait
+         */
+        std::size_t drain(SDL_Event* buffer, std::size_t capacity);
+
+        //! a fixed capacity buffer of events taken from the queue at once
+        /*!
+         * iterating visits the events in queue order as const SDL_Event&,
+         * each<T>() only those of one EventType as Event<T>; neither copies
+         * nor allocates.
+         */
+        template<std::size_t Capacity = 64>
+        class EventBatch {
+            SDL_Event events[Capacity];
+            std::size_t count;
+        public:
+            EventBatch() : count(0) {}
+
+            //! replace the content with pending events, see event::drain()
+            std::size_t drain();
+            std::size_t size() const { return count; }
+            bool empty() const { return count == 0; }
+            const SDL_Event* begin() const { return events; }
+            const SDL_Event* end() const { return events + count; }
+
+            //! call f(const Event<T>&) for every event of type T
+            template<EventType::type T, typename F>
+            void each(F f) const;
+        };
+
+        //! the SDL event type of MessageQueue wake ups, registered once
+        std::uint32_t messageEventType();
+
+        //! lock free queue of messages from any thread to the event thread
+        /*!
+         * push() never takes a lock (only the node allocation may) and
+         * pushes one SDL user event of messageEventType(), with data1 set
+         * to the queue, when the queue was idle, so a thread blocked in
+         * event::wait() wakes up and the SDL event queue sees one event per
+         * burst instead of one per message. On such an event (see wakes())
+         * the event thread calls drain().
+         *
+         * Drain the queue before destroying it; a wake up event may still
+         * be queued, and wakes() compares only the address.
+         */
+        template<typename T>
+        class MessageQueue {
+            struct Node {
+                std::atomic<Node*> next;
+                typename std::aligned_storage<sizeof(T),
+                                              alignof(T)>::type value;
+                Node() : next(nullptr) {}
+                T *get() { return reinterpret_cast<T*>(&value); }
+            };
+            std::atomic<Node*> head;    //!< last pushed, producers swap it
+            Node *tail;                 //!< value-less, owned by the consumer
+            std::atomic<bool> signalled;
+        public:
+            MessageQueue();
+            ~MessageQueue();
+            MessageQueue(const MessageQueue&) = delete;
+            MessageQueue& operator=(const MessageQueue&) = delete;
+
+            //! from any thread
+            void push(T message);
+
+            //! from the event thread only, f(T&) for every queued message
+            //! @return number of messages
+            template<typename F>
+            std::size_t drain(F f);
+
+            //! whether e is a wake up pushed by this queue
+            bool wakes(const SDL_Event& e) const;
+        };
+
         //! %event that could be pass around
         /*!
           a unique_ptr like wrapper which is constructed from
           EventData, has move ctor and assignment but noncopyable. Through
           EventHandler user can only access event type and timestamp, more
-          specific event data are exposed through Event.
+          specific event data are exposed through Event. The SDL_Event is
+          stored inline, so no event operation allocates memory; a moved
+          from EventHandler is empty.
         */
         class EventHandler {
         public:
@@ -186,11 +454,16 @@ namespace sdlpp {
 
             EventType::type type() const;
             Timestamp timestamp() const;
+
+            //! the SDL event
+            //! @throw DereferenceFailure when empty
+            const SDL_Event* get() const;
         protected:
-           std::unique_ptr<SDL_Event> ptr; //!< delegate move semantics to unique_ptr
-           static EventHandler create(SDL_Event*e);
+           SDL_Event event;
+           bool valid;    //!< event holds data
+           static EventHandler create(const SDL_Event& e);
         private:
-           EventHandler(SDL_Event*e) : ptr(e) {};
+           explicit EventHandler(const SDL_Event& e) : event(e), valid(true) {};
 
            // deleted copy ctor
            EventHandler(const EventHandler& e);
@@ -199,6 +472,92 @@ namespace sdlpp {
            EventHandler& operator=(const EventHandler& e);
         };
 
+        namespace detail {
+            //! the Event<T> a handler takes, from its operator()
+            template<typename F>
+            struct HandlerTraits : HandlerTraits<decltype(&F::operator())> {};
+            template<typename C, typename R, typename A>
+            struct HandlerTraits<R (C::*)(A) const> {
+                typedef typename std::decay<A>::type event;
+            };
+            template<typename C, typename R, typename A>
+            struct HandlerTraits<R (C::*)(A)> {
+                typedef typename std::decay<A>::type event;
+            };
+            template<typename R, typename A>
+            struct HandlerTraits<R (*)(A)> {
+                typedef typename std::decay<A>::type event;
+            };
+
+            template<typename E> struct KindOf;
+            template<EventType::type T>
+            struct KindOf<Event<T>> {
+                static const EventType::type value = T;
+            };
+
+            //! index of the first handler taking Event<T>, I when none
+            template<EventType::type T, std::size_t I, typename... Hs>
+            struct Find {
+                static const std::size_t value = I;
+            };
+            template<EventType::type T, std::size_t I, typename H, typename... Hs>
+            struct Find<T, I, H, Hs...> {
+                static const std::size_t value =
+                    KindOf<typename HandlerTraits<H>::event>::value == T
+                    ? I : Find<T, I + 1, Hs...>::value;
+            };
+
+            template<std::size_t... Is> struct Indices {};
+            template<std::size_t N, std::size_t... Is>
+            struct MakeIndices : MakeIndices<N - 1, N - 1, Is...> {};
+            template<std::size_t... Is>
+            struct MakeIndices<0, Is...> { typedef Indices<Is...> type; };
+        }
+
+        //! calls the handler for the type of an event through one table
+        /*!
+         * every handler is a function object taking one const Event<T>&,
+         * e.g. a lambda; the first handler for T gets the events of
+         * EventType T, events of a type nobody handles are ignored. The
+         * table from EventType to handler is built at compile time, so a
+         * dispatch is typeOf() and one indirect call.
+         *
+         *     auto dispatch = makeDispatcher(
+         *         [&](const Event<EventType::Quit>&) { running = false; },
+         *         [&](const Event<EventType::Keyboard>& k) { ... });
+         *     while (poll(data)) dispatch(data);
+         */
+        template<typename... Handlers>
+        class Dispatcher {
+            typedef bool (*Entry)(Dispatcher&, const SDL_Event&);
+            std::tuple<Handlers...> handlers;
+
+            template<EventType::type T>
+            static bool call(Dispatcher& d, const SDL_Event& e);
+            template<EventType::type T>
+            static bool invoke(Dispatcher&, const SDL_Event&,
+                               std::integral_constant<std::size_t, sizeof...(Handlers)>) {
+                return false;
+            }
+            template<EventType::type T, std::size_t I>
+            static bool invoke(Dispatcher& d, const SDL_Event& e,
+                               std::integral_constant<std::size_t, I>) {
+                std::get<I>(d.handlers)(Event<T>::extract(&e));
+                return true;
+            }
+            template<std::size_t... Is>
+            static const Entry *table(detail::Indices<Is...>);
+        public:
+            explicit Dispatcher(Handlers... hs);
+
+            //! @return whether a handler took e
+            bool operator()(const SDL_Event& e);
+            bool operator()(const EventHandler& e);
+        };
+
+        template<typename... Handlers>
+        Dispatcher<Handlers...> makeDispatcher(Handlers... hs);
+
         //! %event that can be polled or waited
         /*!
          *   the storage to store events. It has the same
@@ -207,12 +566,8 @@ namespace sdlpp {
         class EventData : public EventHandler {
             friend bool poll(EventData& eh);
             friend void wait(EventData& eh);
-           void initptr();
         public:
-            /*! copy EventData to a EventHandler for storing or passing around.
-             *  a EventHandler only stores relavent part in the SDL_Event
-             *  union, hence uses less memory than original EventData.
-             */
+            //! copy EventData to a EventHandler for storing or passing around.
             EventHandler slice();
         };
     } // end namespace event
@@ -315,15 +670,37 @@ namespace sdlpp {
         PixelValue mapRGBA(SDL_PixelFormat *format);
     };
 
+    //! how many state changes reached SDL and how many were skipped
+    //! because the value was already set
+    struct StateStats {
+        std::size_t issued;
+        std::size_t elided;
+    };
+
+    //! read only bytes owned by someone else
+    struct MemoryRegion {
+        const void *data;
+        std::size_t size;
+    };
+
     class Window;
     class Texture;
     class TargetTexture;
     class StaticTexture;
     class StreamingTexture;
+    class TextureAtlas;
+    struct AtlasRegion;
 
     //! A Renderer always associsated with a Window
+    /*!
+     * setDrawColor() and setTarget() remember what they set and skip the
+     * SDL call when the value does not change; call invalidate() after
+     * changing the state through get() directly.
+     */
     class Renderer : public PointerHolder<SDL_Renderer> {
         friend Window;
+        friend class OffscreenTarget;
+        friend class TexturePool;
         Renderer(SDL_Renderer* p);
         template<typename T>
         T createTexture(PixelFormat format, SDL_TextureAccess access, int width, int height);
@@ -358,6 +735,10 @@ namespace sdlpp {
                 const Position* center = nullptr,
                 SDL_RendererFlip flip = SDL_FLIP_NONE);
 
+        //! copy a region of an atlas, stretched to destrect
+        void copy(TextureAtlas& atlas, AtlasRegion region,
+                const Rectangle* destrect = nullptr);
+
         //! update the screen with rendering performed
         void present();
 
@@ -391,6 +772,15 @@ namespace sdlpp {
         //! @see setTarget()
         TargetTexture spawnTarget(int width, int height,
                 PixelFormat format = DEFAULT_PIXEL_FORMAT);
+
+        //! forget the remembered state, the next setters always reach SDL
+        void invalidate();
+        //! counters of setDrawColor() and setTarget() calls
+        const StateStats& stats() const;
+    private:
+        std::uint32_t drawColor;
+        bool drawColorKnown;
+        StateStats counters;
     };
 
     //! describe the memory layout which depneds on the endianess of hardware
@@ -409,11 +799,141 @@ namespace sdlpp {
          PixelMask(PixelFormat format = DEFAULT_PIXEL_FORMAT);
     };
 
+    //! bulk routines on 32 bit pixels, with per instruction set versions
+    /*!
+     * every instruction set provides a Table of the same kernels which
+     * must produce bit-exact results; best() picks the fastest one the
+     * running cpu supports.
+     */
+    namespace kernel {
+        struct Isa {
+            enum type {
+                Scalar,
+                SSE2,
+                AVX2
+            };
+        };
+
+        struct Table {
+            //! store value into dst[0] .. dst[n-1]
+            void (*fill)(std::uint32_t *dst, std::size_t n, std::uint32_t value);
+
+            //! clear amask bits of pixels whose other bits equal key
+            void (*colorKey)(std::uint32_t *p, std::size_t n,
+                    std::uint32_t key, std::uint32_t amask);
+
+            //! swap byte 0 and byte 2 of each pixel, ARGB8888 <-> ABGR8888
+            void (*swapRB)(std::uint32_t *dst, const std::uint32_t *src,
+                    std::size_t n);
+
+            //! p[i] = PixelBlend<M>::apply(p[i], src, alpha) for i < n,
+            //! with M BlendMode::Blend, Add and Mod respectively
+            void (*blend)(std::uint32_t *p, std::size_t n, std::uint32_t src,
+                    std::uint8_t alpha);
+            void (*add)(std::uint32_t *p, std::size_t n, std::uint32_t src,
+                    std::uint8_t alpha);
+            void (*mod)(std::uint32_t *p, std::size_t n, std::uint32_t src,
+                    std::uint8_t alpha);
+        };
+
+        //! @return true if the running cpu can execute isa
+        bool supported(Isa::type isa);
+
+        //! @warning make sure supported(isa) is true
+        const Table& table(Isa::type isa);
+
+        //! the table of the best supported instruction set
+        const Table& best();
+
+        //! best(), looked up once at start-up for the span functions;
+        //! the scalar table until then
+        extern const Table *current;
+    }
+
+    //! the contiguous pixels of one row, usable in range-based for
+    template<typename T>
+    struct PixelSpan {
+        T *first;
+        int count;
+        T *begin() const { return first; }
+        T *end() const { return first + count; }
+        int size() const { return count; }
+        T& operator[](int x) const { return first[x]; }
+    };
+
+    //! rows of pixel memory which are pitch bytes apart
+    /*!
+     * for (auto row : surface.rows()) for (auto& pixel : row) ... compiles
+     * to plain pointer arithmetic.
+     */
+    template<typename T>
+    class PixelRows {
+        std::uint8_t *bytes;
+        int pitch, count, rows;
+    public:
+        class iterator {
+            std::uint8_t *p;
+            int pitch, count;
+        public:
+            iterator(std::uint8_t *b, int pitch, int count)
+                : p(b), pitch(pitch), count(count) {}
+            PixelSpan<T> operator*() const {
+                PixelSpan<T> s = { reinterpret_cast<T*>(p), count };
+                return s;
+            }
+            iterator& operator++() { p += pitch; return *this; }
+            bool operator!=(const iterator& o) const { return p != o.p; }
+            bool operator==(const iterator& o) const { return p == o.p; }
+        };
+
+        /*!
+         * @param pixels address of the first row
+         * @param pitch bytes from one row to the next
+         * @param count number of T in a row
+         * @param rows number of rows
+         */
+        PixelRows(void *pixels, int pitch, int count, int rows)
+            : bytes(static_cast<std::uint8_t*>(pixels)), pitch(pitch),
+              count(count), rows(rows) {}
+        iterator begin() const { return iterator(bytes, pitch, count); }
+        iterator end() const {
+            return iterator(bytes + rows * pitch, pitch, count);
+        }
+        PixelSpan<T> operator[](int y) const {
+            return *iterator(bytes + y * pitch, pitch, count);
+        }
+        int size() const { return rows; }
+    };
+
+    //! a bounded list of rectangles covering the changed pixels
+    /*!
+     * add() merges a rectangle into the ones it overlaps as long as the
+     * merged rectangle wastes no more area than the parts cover, and when
+     * the list is full the pair wasting the least area is merged, so the
+     * list stays short enough to hand to Window::update().
+     */
+    class DirtyRegion {
+        std::vector<Rectangle> list;
+        std::size_t capacity;
+    public:
+        //! @param capacity maximal number of rectangles, at least 1
+        explicit DirtyRegion(std::size_t capacity = 16);
+        void add(const Rectangle& rect);
+        const std::vector<Rectangle>& rects() const;
+        bool empty() const;
+        void clear();
+        //! bounding box of all rectangles, empty if there is none
+        Rectangle bounds() const;
+    };
+
     //! a collection of pixels used in software blitting
     class Surface: public PointerHolder<SDL_Surface> {
         friend Window;
+        friend class SurfacePool;
+        friend class CachedSurface;
     private:
         bool needDeallocate;
+        DirtyRegion *dirty;
 
     protected:
         /*!
@@ -432,6 +952,12 @@ namespace sdlpp {
 
         //! load image through SDL2_image extension library
         static Surface loadIMG(const std::string& path);
+
+        //! decode an image file already in memory, e.g. in a PackFile;
+        //! the memory is read in place
+        //! @throw error::RuntimeError if data is 2 GB or larger
+        static Surface loadBMP(MemoryRegion data);
+        static Surface loadIMG(MemoryRegion data);
         struct LoadFailure : public error::RuntimeError {
             using error::RuntimeError::RuntimeError;
         };
@@ -447,6 +973,10 @@ namespace sdlpp {
         void blitScaled(const Surface& src, Rectangle* srcrect = nullptr,
                   Rectangle* destrect = nullptr);
 
+        //! add the area written by following blits to region, nullptr to
+        //! stop tracking. @warning region must outlive the tracking
+        void trackDirty(DirtyRegion *region);
+
         SDL_PixelFormat *getFormat();
         PixelFormat format();
 
@@ -464,11 +994,46 @@ namespace sdlpp {
         //! blitting to a surface of a specified pixel format
         Surface convert(const SDL_PixelFormat *format);
 
+        //! like convert(), ARGB8888 <-> ABGR8888 is done by kernel::swapRB
+        Surface convert(PixelFormat format);
+
+        //! make pixels of color c fully transparent, the surface must have
+        //! 4 byte pixels with an alpha channel
+        void keyToAlpha(const Color& c);
+
+        //! set colors[0 .. n-1] as palette entries first .. first+n-1,
+        //! the surface must have an indexed format
+        void setPalette(const Color *colors, int n, int first = 0);
+
         //! raw pixel data
         void *pixels();
 
         //! Bytes Per Pixel
         int Bpp();
+
+        //! @warning SDL_MUSTLOCK() surfaces need a SurfaceLock first
+        template<typename T>
+        PixelRows<T> rows();
+    };
+
+    //! lock a surface for direct pixel access while in scope
+    /*!
+     * only surfaces for which SDL_MUSTLOCK() holds, e.g. RLE accelerated
+     * ones, are really locked, for the others this is free.
+     */
+    class SurfaceLock {
+        SDL_Surface *surface;
+    public:
+        //! @throw error::RuntimeError if the surface can not be locked
+        explicit SurfaceLock(Surface& s);
+        ~SurfaceLock();
+        SurfaceLock(const SurfaceLock&) = delete;
+        SurfaceLock& operator=(const SurfaceLock&) = delete;
+
+        void *pixels();
+        //! rows of T, e.g. std::uint32_t for 4 byte pixels
+        template<typename T>
+        PixelRows<T> rows();
     };
 
     template<typename T>
@@ -477,6 +1042,135 @@ namespace sdlpp {
     };
     class Bpp4Surface;
     template<> struct Drawable<Bpp4Surface> { static const bool value = 1; };
+    class Bpp4View;
+    template<> struct Drawable<Bpp4View> { static const bool value = 1; };
+    template<typename Layout> class PixelSurface;
+    template<typename Layout>
+    struct Drawable<PixelSurface<Layout>> { static const bool value = 1; };
+
+    //! draw color prepared once for the blending span kernels
+    struct BlendColor {
+        //! premultiplied color mapped to the canvas format, with alpha 0
+        //! for BlendMode::Add and unpremultiplied with alpha 0xff for
+        //! BlendMode::Mod, so that every channel follows the same formula
+        PixelValue pixel;
+        //! components of pixel
+        std::uint8_t red, green, blue, alpha;
+
+        /*!
+         * the color drawn on a pixel covered by coverage / 255, i.e. a
+         * weaker color for Blend and Add and a color closer to white for
+         * Mod. pixel is scaled bytewise, so it is only meaningful for
+         * formats of four 8 bit channels.
+         */
+        BlendColor scaled(std::uint8_t coverage, BlendMode::type m) const;
+    };
+
+    //! round(v / 255) for v in [0, 255 * 255]
+    inline std::uint32_t div255(std::uint32_t v) {
+        v += 0x80;
+        return (v + (v >> 8)) >> 8;
+    }
+
+    inline BlendColor BlendColor::scaled(std::uint8_t coverage,
+                                         BlendMode::type m) const {
+        // bytes of v * coverage / 255, all four channels in parallel
+        auto scale = [coverage](std::uint32_t v) {
+            std::uint32_t rb = (v & 0x00ff00ff) * coverage + 0x00800080;
+            std::uint32_t ag = ((v >> 8) & 0x00ff00ff) * coverage + 0x00800080;
+            rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+            ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+            return rb | ag;
+        };
+        BlendColor c;
+        if (m == BlendMode::Mod) {
+            c.pixel = ~scale(~pixel);
+            c.red = 0xff - div255((0xff - red) * coverage);
+            c.green = 0xff - div255((0xff - green) * coverage);
+            c.blue = 0xff - div255((0xff - blue) * coverage);
+            c.alpha = alpha;
+        } else {
+            c.pixel = scale(pixel);
+            c.red = div255(red * coverage);
+            c.green = div255(green * coverage);
+            c.blue = div255(blue * coverage);
+            c.alpha = div255(alpha * coverage);
+        }
+        return c;
+    }
+
+    //! blend one pixel made of four 8 bit channels, dst is the canvas pixel
+    //! and src is BlendColor::pixel, all channels are done in parallel;
+    //! channel() does the same on one 8 bit channel for other formats
+    template<BlendMode::type M>
+    struct PixelBlend;
+
+    //! dst = src + dst * (1 - srcA)
+    template<>
+    struct PixelBlend<BlendMode::Blend> {
+        static PixelValue apply(PixelValue dst, PixelValue src,
+                                std::uint8_t alpha) {
+            std::uint32_t inv = 0xff - alpha;
+            std::uint32_t rb = (dst & 0x00ff00ff) * inv + 0x00800080;
+            std::uint32_t ag = ((dst >> 8) & 0x00ff00ff) * inv + 0x00800080;
+            rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+            ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+            return src + (rb | ag);
+        }
+        static std::uint8_t channel(std::uint32_t dst, std::uint32_t src,
+                                    std::uint8_t alpha) {
+            return src + div255(dst * (0xff - alpha));
+        }
+        //! apply() to p[0] .. p[n-1]
+        static void span(std::uint32_t *p, std::size_t n,
+                         const BlendColor& c) {
+            kernel::current->blend(p, n, c.pixel, c.alpha);
+        }
+    };
+
+    //! dst = min(src + dst, 0xff)
+    template<>
+    struct PixelBlend<BlendMode::Add> {
+        static PixelValue apply(PixelValue dst, PixelValue src,
+                                std::uint8_t) {
+            std::uint32_t rb = (dst & 0x00ff00ff) + (src & 0x00ff00ff);
+            std::uint32_t ag = ((dst >> 8) & 0x00ff00ff) +
+                               ((src >> 8) & 0x00ff00ff);
+            rb |= ((rb >> 8) & 0x00010001) * 0xff;
+            ag |= ((ag >> 8) & 0x00010001) * 0xff;
+            return (rb & 0x00ff00ff) | ((ag & 0x00ff00ff) << 8);
+        }
+        static std::uint8_t channel(std::uint32_t dst, std::uint32_t src,
+                                    std::uint8_t) {
+            return std::min<std::uint32_t>(dst + src, 0xff);
+        }
+        static void span(std::uint32_t *p, std::size_t n,
+                         const BlendColor& c) {
+            kernel::current->add(p, n, c.pixel, c.alpha);
+        }
+    };
+
+    //! dst = src * dst
+    template<>
+    struct PixelBlend<BlendMode::Mod> {
+        static PixelValue apply(PixelValue dst, PixelValue src,
+                                std::uint8_t) {
+            PixelValue v = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                v |= div255(((dst >> shift) & 0xff) * ((src >> shift) & 0xff))
+                    << shift;
+            }
+            return v;
+        }
+        static std::uint8_t channel(std::uint32_t dst, std::uint32_t src,
+                                    std::uint8_t) {
+            return div255(dst * src);
+        }
+        static void span(std::uint32_t *p, std::size_t n,
+                         const BlendColor& c) {
+            kernel::current->mod(p, n, c.pixel, c.alpha);
+        }
+    };
 
     template<typename Derived>
     class Canvas;
@@ -495,19 +1189,118 @@ namespace sdlpp {
     };
 
     //! for CRTP (static polymorphism)
-    //! Canvas depend on Derived::setPixel(), Derived::getPixel() and
-    //! Dervived::getFormat(), Derived::width(), Derived::height()
+    //! Canvas depend on Derived::setPixel(), Derived::getPixel(),
+    //! Derived::fillSpan(), Derived::blendSpan<BlendMode>(),
+    //! Dervived::getFormat(), Derived::width() and Derived::height()
     template<typename Derived>
     class Canvas {
         static_assert(Drawable<Derived>::value, "Derived is invalid");
         friend PixelCell<Derived>;
         PixelValue drawColor;
+        Color drawRGBA;
+        BlendMode::type blendMode;
+        BlendColor blendColor;
+        Rectangle clip;
+        bool clipEnabled;
+        DirtyRegion *dirty;
+
+        //! add [xa, xb] x [ya, yb] inside the clip rectangle to dirty
+        void touch(int xa, int ya, int xb, int yb);
+
+        //! rebuild blendColor from drawRGBA and blendMode
+        void prepareBlend();
+
+        //! write row y from x0 to x1 (x0 <= x1, unclipped) by blendMode,
+        //! the kernel for each mode is selected at compile time
+        void paint(int y, int x0, int x1);
+
+        //! like paint() with color c, BlendMode::None is done as Blend
+        void blend(int y, int x0, int x1, const BlendColor& c);
+
+        //! inclusive bounds of drawable pixels
+        struct Bounds {
+            int x0, y0, x1, y1;
+            bool contains(int x, int y) const;
+            //! 0 if [xa, xb] x [ya, yb] is outside, 2 if inside, otherwise 1
+            int overlap(int xa, int ya, int xb, int yb) const;
+        };
+        Bounds bounds();
+
+        //! set (x, y) to drawColor, skipped when Clip and (x, y) is outside box
+        template<bool Clip>
+        void plot(const Bounds& box, int x, int y);
+
+        //! fill row y from x0 to x1 (in any order) with drawColor, clipped
+        void span(const Bounds& box, int y, int x0, int x1);
+
+        /*!
+         * clip line ab to box: a and b are moved to the first and last
+         * pixels of the drawLine() path inside box, and err is set to the
+         * error term at the new a, so the clipped line is pixel exact.
+         * @return false if no pixel is inside box
+         */
+        static bool clipLine(const Bounds& box, Position& a, Position& b,
+                             int& err);
+
+        //! blend (x, y) with the drawing color weighted by 255 - intensity,
+        //! intensity outside [0, 255) leaves the pixel untouched
+        template<bool Clip>
+        void plotAA(const Bounds& box, int x, int y, int intensity);
+        //! plotAA() at (xa, ya), (xb, ya), (xa, yb) and (xb, yb), each
+        //! pixel once when mirrored points meet on an axis
+        template<bool Clip>
+        void plotAA4(const Bounds& box, int xa, int xb, int ya, int yb,
+                     int intensity);
+
+        //! outline rasterizers, Clip is false if the shape is inside box
+        template<bool Clip>
+        void rasterCircle(const Bounds& box, Position center, int radius);
+        template<bool Clip>
+        void rasterEllipse(const Bounds& box, Position center, Position radius);
+        template<bool Clip>
+        void rasterEllipse(const Bounds& box, Rectangle rect);
+        template<bool Clip>
+        void rasterLineAA(const Bounds& box, Position a, Position b);
+        template<bool Clip>
+        void rasterLineAA(const Bounds& box, Position a, Position b,
+                          double width);
+        template<bool Clip>
+        void rasterCircleAA(const Bounds& box, Position center, int radius);
+        template<bool Clip>
+        void rasterEllipseAA(const Bounds& box, Rectangle rect);
     public:
         PixelValue getPixel(int x, int y); //!< inelined to Dervied::getPixel()
         void setPixel(int x, int y, PixelValue v); //!< inlined to Derived::setPixel()
-        Canvas() : drawColor(0) {}
+
+        //! set pixels (x0, y) .. (x1, y) inclusively, requires x0 <= x1
+        //! inlined to Derived::fillSpan()
+        void fillSpan(int y, int x0, int x1, PixelValue v);
+        Canvas() : drawColor(0), drawRGBA(0, 0, 0, 0),
+                   blendMode(BlendMode::None), clipEnabled(false),
+                   dirty(nullptr) {}
         int getHeight();
         int getWidth();
+
+        /*!
+         * restrict all drawing primitives to rect, partially visible shapes
+         * are clipped, not wrapped or written out of the pixel memory.
+         * @param rect pass nullptr to draw on the whole canvas again
+         * @return false if rect and the canvas do not intersect, which
+         *         makes every following drawing a no-op
+         */
+        bool setClipRect(const Rectangle* rect = nullptr);
+
+        //! @return the clip rectangle, or the whole canvas when unset
+        Rectangle getClipRect();
+
+        /*!
+         * add the area changed by following drawing to region, nullptr to
+         * stop tracking. setPixel() and fillSpan() write raw pixels and
+         * are not tracked. @warning region must outlive the tracking
+         */
+        void trackDirty(DirtyRegion *region);
+
+        //! fill the clip rectangle with the drawing color, never blended
         void clear();
         void drawPoint(Position pos);
         void drawLine(Position a, Position b);
@@ -519,10 +1312,26 @@ namespace sdlpp {
         void fillRectangle(Rectangle rect);
         void drawCircle(Position center, int radius);
         void fillCircle(Position center, int radius);
+
+        //! anti-aliased (Xiaolin Wu like) versions of the outlines, edge
+        //! pixels are blended with the drawing color by their coverage
+        void drawLineAA(Position a, Position b);
+        //! anti-aliased line of width pixels centred on a - b
+        void drawLineAA(Position a, Position b, double width);
+        void drawCircleAA(Position center, int radius);
+        void drawEllipseAA(Position center, Position radius);
+        void drawEllipseAA(Rectangle rect); //!< ellipse inside a rectangle
+        //! canvas[x][y] access to one pixel, convenient but slow in loops,
+        //! use row() or rows() of the derived class there
         PixelCell<Derived> operator[](int x);
         void setDrawColor(Color color);
         void setDrawPixel(PixelValue pv);
 
+        //! how drawing operations (except clear()) combine the drawing
+        //! color with the canvas, same formulas as SDL_BlendMode
+        void setBlendMode(BlendMode::type m);
+        BlendMode::type getBlendMode();
+
         //! delegate to canvas implementation class
         SDL_PixelFormat *getPixelFormat();
     };
@@ -530,39 +1339,319 @@ namespace sdlpp {
     class Bpp4Surface : public Surface, public Canvas<Bpp4Surface> {
     public:
         Bpp4Surface(int width, int height, PixelFormat format);
+        //! track both drawing and blits
+        void trackDirty(DirtyRegion *region);
         void setPixel(int x, int y, PixelValue value);
         PixelValue getPixel(int x, int y);
+        void fillSpan(int y, int x0, int x1, PixelValue value);
+        template<BlendMode::type M>
+        void blendSpan(int y, int x0, int x1, const BlendColor& color);
+
+        //! the width() pixels of row y, faster than operator[] for loops
+        std::uint32_t *row(int y);
+        PixelRows<std::uint32_t> rows();
     private:
         static PixelFormat check(PixelFormat format);
     };
 
-    //! small object which is moveable and repsent a canvas
-    /*! like a Surface but is optimized for GPU renderin */
-    class Texture : public PointerHolder<SDL_Texture> {
-        friend Renderer;
-    protected:
-        Texture(SDL_Texture* t);
+    //! a canvas drawing on the pixels of a Bpp4Surface without owning them
+    /*!
+     * each view has its own drawing color, blend mode and clip rectangle,
+     * so views clipped to disjoint rectangles may draw concurrently.
+     * @warning the surface must outlive the view
+     */
+    class Bpp4View : public Canvas<Bpp4View> {
+        std::uint8_t *bytes;
+        int w, h, stride;
+        SDL_PixelFormat *fmt;
     public:
-        Texture(Renderer& r, Surface& s);
-        Texture(Renderer& r, Surface&& s);
-        ~Texture();
-
-        //! alpha field is not used
-        void setColorMod(const Color& color);
-        void setAlphaMod(std::uint8_t alpha);
-        void setBlendMode(BlendMode::type m);
-        Texture(Texture&& t);
+        explicit Bpp4View(Bpp4Surface& s);
+        //! over foreign memory of 4 byte pixels, e.g. a locked texture
+        Bpp4View(void *pixels, int width, int height, int pitch,
+                 SDL_PixelFormat *format);
+        void setPixel(int x, int y, PixelValue value);
+        PixelValue getPixel(int x, int y);
+        void fillSpan(int y, int x0, int x1, PixelValue value);
+        template<BlendMode::type M>
+        void blendSpan(int y, int x0, int x1, const BlendColor& color);
+        SDL_PixelFormat *getFormat();
+        int width() const;
+        int height() const;
+        std::uint32_t *row(int y);
+        PixelRows<std::uint32_t> rows();
     };
 
-    //! TargetTexture acted as a destination of rendering
-    class TargetTexture : public Texture {
-        friend Renderer;
-        TargetTexture(SDL_Texture* t);
-    };
+    //! how PixelSurface stores a pixel in memory
+    /*!
+     * a layout provides type (the unit of rows), bytes, indexed, accepts()
+     * telling whether a pixel format uses the layout, and load(), store()
+     * and fill() on raw bytes.
+     */
+    namespace layout {
+        //! 16 bit pixels, e.g. RGB565 or ARGB4444
+        struct Bpp2 {
+            typedef std::uint16_t type;
+            static const int bytes = 2;
+            static const bool indexed = false;
+            static bool accepts(PixelFormat f) {
+                return SDL_BYTESPERPIXEL(f) == 2 && !SDL_ISPIXELFORMAT_INDEXED(f);
+            }
+            static PixelValue load(const std::uint8_t *p) {
+                return *reinterpret_cast<const std::uint16_t*>(p);
+            }
+            static void store(std::uint8_t *p, PixelValue v) {
+                *reinterpret_cast<std::uint16_t*>(p) = (std::uint16_t)v;
+            }
+            static void fill(std::uint8_t *p, int n, PixelValue v) {
+                auto q = reinterpret_cast<std::uint16_t*>(p);
+                std::fill(q, q + n, (std::uint16_t)v);
+            }
+        };
 
-    //! not subjective to changes, mostly used as source texture
-    class StaticTexture : public Texture {
-        friend Renderer;
+        //! packed 24 bit pixels, e.g. RGB24 or BGR24
+        struct Bpp3 {
+            typedef std::uint8_t type; //!< 3 per pixel
+            static const int bytes = 3;
+            static const bool indexed = false;
+            static bool accepts(PixelFormat f) {
+                return SDL_BYTESPERPIXEL(f) == 3;
+            }
+            static PixelValue load(const std::uint8_t *p) {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+                return (p[0] << 16) | (p[1] << 8) | p[2];
+#else
+                return p[0] | (p[1] << 8) | (p[2] << 16);
+#endif
+            }
+            static void store(std::uint8_t *p, PixelValue v) {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+                p[0] = v >> 16; p[1] = v >> 8; p[2] = v;
+#else
+                p[0] = v; p[1] = v >> 8; p[2] = v >> 16;
+#endif
+            }
+            //! store one pixel, then double the filled bytes by memcpy
+            static void fill(std::uint8_t *p, int n, PixelValue v) {
+                if (n <= 0) return;
+                store(p, v);
+                std::size_t done = bytes, total = (std::size_t)n * bytes;
+                while (done < total) {
+                    std::size_t k = std::min(done, total - done);
+                    std::memcpy(p + done, p, k);
+                    done += k;
+                }
+            }
+        };
+
+        //! 8 bit palette indices, e.g. INDEX8
+        struct Bpp1 {
+            typedef std::uint8_t type;
+            static const int bytes = 1;
+            static const bool indexed = true;
+            static bool accepts(PixelFormat f) {
+                return SDL_BYTESPERPIXEL(f) == 1 && SDL_ISPIXELFORMAT_INDEXED(f);
+            }
+            static PixelValue load(const std::uint8_t *p) { return *p; }
+            static void store(std::uint8_t *p, PixelValue v) {
+                *p = (std::uint8_t)v;
+            }
+            static void fill(std::uint8_t *p, int n, PixelValue v) {
+                std::memset(p, (std::uint8_t)v, n);
+            }
+        };
+    }
+
+    //! a surface and canvas whose pixels are stored as Layout describes
+    /*!
+     * setPixel(), getPixel() and fillSpan() are specialized per layout at
+     * compile time. Blending decodes the channels of each pixel by the
+     * format's masks, so it is slower than on a Bpp4Surface; on indexed
+     * surfaces it goes through the palette and the result is the nearest
+     * palette color.
+     */
+    template<typename Layout>
+    class PixelSurface : public Surface, public Canvas<PixelSurface<Layout>> {
+    public:
+        //! @throw error::RuntimeError if format does not use Layout
+        PixelSurface(int width, int height, PixelFormat format);
+        //! track both drawing and blits
+        void trackDirty(DirtyRegion *region);
+        void setPixel(int x, int y, PixelValue value);
+        PixelValue getPixel(int x, int y);
+        void fillSpan(int y, int x0, int x1, PixelValue value);
+        template<BlendMode::type M>
+        void blendSpan(int y, int x0, int x1, const BlendColor& color);
+
+        typedef typename Layout::type type;
+        //! row y as width() * Layout::bytes / sizeof(type) units of type
+        type *row(int y);
+        PixelRows<type> rows();
+    private:
+        static PixelFormat check(PixelFormat format);
+        std::uint8_t *bytes(int y);
+        //! one channel of a pixel by the masks of its format, what
+        //! SDL_GetRGBA() and SDL_MapRGBA() do without the calls
+        static std::uint8_t decode(PixelValue v, std::uint32_t mask,
+                                   int shift, int loss);
+        static PixelValue encode(std::uint8_t c, std::uint32_t mask,
+                                 int shift, int loss);
+    };
+
+    typedef PixelSurface<layout::Bpp2> Bpp2Surface; //!< e.g. RGB565
+    typedef PixelSurface<layout::Bpp3> Bpp3Surface; //!< e.g. RGB24
+    typedef PixelSurface<layout::Bpp1> Bpp1Surface; //!< e.g. INDEX8
+
+    //! fixed number of worker threads running queued tasks
+    class ThreadPool {
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex lock;
+        std::condition_variable wakeup, idle;
+        std::size_t running;
+        bool stopping;
+
+        void work();
+    public:
+        //! @param threads number of workers, 0 for one per cpu core
+        explicit ThreadPool(unsigned threads = 0);
+        //! finish all queued tasks, then join the workers
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        //! queue task, it runs on one of the workers
+        void post(std::function<void()> task);
+        //! block until every posted task has finished, not from a task
+        void wait();
+        unsigned size() const;
+        //! whether the calling thread is one of the workers
+        bool isWorker() const;
+    };
+
+    //! records drawing on a Bpp4Surface and rasterizes it tile by tile
+    /*!
+     * drawing calls only append to a command list; flush() bins the
+     * commands to the tiles they touch and rasterizes the tiles in
+     * parallel on a ThreadPool, every tile replaying its commands in
+     * order. Clipping is pixel exact, so the result is identical to
+     * drawing directly on the surface. Call flush() before the surface is
+     * read, e.g. by Surface::blit().
+     */
+    class TiledCanvas {
+        struct Command {
+            enum Op {
+                Clear, Point, Line, Ellipse, FillEllipse, EllipseRect,
+                FillEllipseRect, Rect, FillRect, Circle, FillCircle,
+                LineAA, ThickLineAA, CircleAA, EllipseRectAA
+            } op;
+            Color color;
+            BlendMode::type mode;
+            Rectangle clip;        //!< clip rectangle inside the surface
+            Rectangle box;         //!< touched pixels, inside clip
+            Position a, b;
+            Rectangle rect;
+            int radius;
+            double width;
+        };
+
+        Bpp4Surface& target;
+        ThreadPool& pool;
+        int tileWidth, tileHeight;
+        Color color;
+        BlendMode::type mode;
+        Rectangle clip;
+        std::vector<Command> commands;
+        DirtyRegion *dirty;
+
+        //! append a command touching [xa, xb] x [ya, yb] with current state
+        //! @return nullptr if no touched pixel is inside the clip rectangle
+        Command *record(Command::Op op, int xa, int ya, int xb, int yb);
+        static void replay(Bpp4View& view, const Command& c,
+                           const Rectangle& tile);
+    public:
+        /*!
+         * @param tileWidth, tileHeight size of tiles in pixels, 0 for the
+         *        whole surface width (the default, as long spans fill
+         *        fastest) and 16 rows; smaller tiles balance better but
+         *        replay more commands
+         */
+        TiledCanvas(Bpp4Surface& target, ThreadPool& pool,
+                    int tileWidth = 0, int tileHeight = 16);
+
+        //! rasterize and drop recorded commands, returns when all are drawn;
+        //! called from a task of the pool, the calling worker draws every
+        //! tile itself instead of waiting on the pool it occupies
+        void flush();
+        //! number of recorded commands waiting for flush()
+        std::size_t pending() const;
+
+        //! same as the Canvas methods of the same names
+        void trackDirty(DirtyRegion *region);
+        void setDrawColor(Color color);
+        void setBlendMode(BlendMode::type m);
+        bool setClipRect(const Rectangle* rect = nullptr);
+        void clear();
+        void drawPoint(Position pos);
+        void drawLine(Position a, Position b);
+        void drawEllipse(Position center, Position radius);
+        void fillEllipse(Position center, Position radius);
+        void drawEllipse(Rectangle rect);
+        void fillEllipse(Rectangle rect);
+        void drawRectangle(Rectangle rect);
+        void fillRectangle(Rectangle rect);
+        void drawCircle(Position center, int radius);
+        void fillCircle(Position center, int radius);
+        void drawLineAA(Position a, Position b);
+        void drawLineAA(Position a, Position b, double width);
+        void drawCircleAA(Position center, int radius);
+        void drawEllipseAA(Position center, Position radius);
+        void drawEllipseAA(Rectangle rect);
+    };
+
+    //! small object which is moveable and repsent a canvas
+    /*! like a Surface but is optimized for GPU renderin */
+    /*!
+     * like Renderer, the setters skip the SDL call when the value does not
+     * change; call invalidate() after changing the state through get()
+     */
+    class Texture : public PointerHolder<SDL_Texture> {
+        friend Renderer;
+    protected:
+        Texture(SDL_Texture* t);
+    public:
+        Texture(Renderer& r, Surface& s);
+        Texture(Renderer& r, Surface&& s);
+        ~Texture();
+
+        //! alpha field is not used
+        void setColorMod(const Color& color);
+        void setAlphaMod(std::uint8_t alpha);
+        void setBlendMode(BlendMode::type m);
+        Texture(Texture&& t);
+
+        void invalidate();
+        //! counters of the three setters above
+        const StateStats& stats() const;
+    private:
+        enum { ColorModKnown = 1, AlphaModKnown = 2, BlendModeKnown = 4 };
+        std::uint32_t colorMod;
+        std::uint8_t alphaMod;
+        BlendMode::type blendMode;
+        unsigned known;
+        StateStats counters;
+
+        bool changes(unsigned what, bool same);
+    };
+
+    //! TargetTexture acted as a destination of rendering
+    class TargetTexture : public Texture {
+        friend Renderer;
+        TargetTexture(SDL_Texture* t);
+    };
+
+    //! not subjective to changes, mostly used as source texture
+    class StaticTexture : public Texture {
+        friend Renderer;
         StaticTexture(SDL_Texture* t);
     };
 
@@ -570,6 +1659,611 @@ namespace sdlpp {
     class StreamingTexture : public Texture {
         friend Renderer;
         StreamingTexture(SDL_Texture* t);
+    public:
+        //! texture memory locked for writing, unlocked when destroyed
+        /*!
+         * SDL does not promise that the locked memory holds the old
+         * content, so every pixel of the locked rectangle has to be drawn.
+         */
+        class Lock {
+            friend StreamingTexture;
+            SDL_Texture *texture;
+            SDL_PixelFormat *format;
+            Bpp4View view;
+            Lock(SDL_Texture *t, SDL_PixelFormat *f, void *pixels,
+                 int width, int height, int pitch);
+        public:
+            ~Lock();
+            Lock(Lock&& l);
+            Lock(const Lock&) = delete;
+            Lock& operator=(const Lock&) = delete;
+
+            //! draws directly into the texture memory, (0, 0) is the top
+            //! left corner of the locked rectangle
+            Bpp4View& canvas();
+        };
+
+        //! lock rect, the whole texture when nullptr, for drawing
+        //! @throw error::RuntimeError unless the format has 4 byte pixels
+        Lock lock(const Rectangle* rect = nullptr);
+
+        //! copy rect, or all, of s to the same place in the texture; rect
+        //! is clipped to s first
+        //! @param s a surface of the texture's size and pixel format
+        void update(Surface& s, const Rectangle* rect = nullptr);
+        //! copy every rectangle of region, e.g. what a frame redrew
+        void update(Surface& s, const DirtyRegion& region);
+    };
+
+    //! collects Renderer drawing and issues it in a few SDL calls
+    /*!
+     * runs of points, lines, rectangles or copies sharing a color or a
+     * texture become one SDL_RenderDrawPoints(), SDL_RenderDrawLines(),
+     * SDL_RenderDrawRects(), SDL_RenderFillRects() or (SDL 2.0.18 and
+     * later) SDL_RenderGeometry() call. A line starting where the previous
+     * one ended extends a polyline while the renderer draw blend mode is
+     * SDL_BLENDMODE_NONE; blended lines stay separate, since a polyline
+     * draws the shared vertex once.
+     *
+     * Order::Submission keeps the drawing order, so the picture is the
+     * same as drawing on the Renderer directly. Order::State sorts by kind
+     * and color or texture first, which needs the fewest calls but may
+     * change which primitive is on top where primitives of different runs
+     * overlap, so use it for order independent drawing like particles.
+     *
+     * flush() leaves the draw color of the renderer at the last color
+     * drawn, and the Renderer knows it.
+     */
+    class RenderBatch {
+    public:
+        struct Order {
+            enum type {
+                Submission,
+                State
+            };
+        };
+        explicit RenderBatch(Renderer& r, Order::type order = Order::Submission);
+
+        //! same as the Renderer methods of the same names
+        void setDrawColor(const Color& color);
+        void drawPoint(Position pos);
+        void drawLine(Position a, Position b);
+        void drawRectangle(const Rectangle& rect);
+        void fillRectangle(const Rectangle& rect);
+        void copy(Texture& texture, const Rectangle* srcrect = nullptr,
+                  const Rectangle* destrect = nullptr);
+
+        //! issue and drop the recorded drawing
+        //! @return the number of SDL calls made, color changes included
+        std::size_t flush();
+        //! number of recorded primitives
+        std::size_t size() const;
+    private:
+        struct Item {
+            enum Kind { Point, Line, Rect, FillRect, Copy } kind;
+            std::uint32_t color;    //!< RGBA packed, for all but Copy
+            SDL_Texture *texture;   //!< for Copy
+            SDL_Rect src, dest;     //!< Line uses dest as x0, y0, x1, y1
+            bool hasSrc, hasDest;
+        };
+        Renderer& renderer;
+        Order::type order;
+        std::uint32_t color;
+        std::vector<Item> items;
+
+        Item& push(Item::Kind kind);
+        static bool sameRun(const Item& a, const Item& b);
+        std::size_t drawCopies(const Item *first, const Item *last);
+    };
+
+    //! headless rendering into a surface, no window or video driver needed
+    /*!
+     * a software renderer draws into the surface, so the Renderer API and
+     * Canvas drawing reach the same pixels. SDL may queue renderer calls;
+     * canvas() and the PNG encoders flush them first, so take canvas()
+     * again after drawing through renderer().
+     *
+     * Keep one target per thread and clear it between images rather than
+     * creating a target per image.
+     */
+    class OffscreenTarget {
+    public:
+        struct EncodeFailure : public error::RuntimeError {
+            using error::RuntimeError::RuntimeError;
+        };
+        OffscreenTarget(int width, int height,
+                        PixelFormat format = SDL_PIXELFORMAT_ARGB8888);
+
+        Renderer& renderer();
+        //! the pixels, with all renderer calls done
+        Bpp4Surface& canvas();
+        //! finish queued renderer calls
+        void flush();
+        int width() const;
+        int height() const;
+
+        //! encode the pixels as PNG into out, reusing its capacity
+        void encodePNG(std::vector<std::uint8_t>& out);
+        std::vector<std::uint8_t> encodePNG();
+        void savePNG(const std::string& path);
+    private:
+        Bpp4Surface surface;
+        Renderer render;
+    };
+
+    //! handle of a surface inserted into a TextureAtlas
+    struct AtlasRegion {
+        std::uint32_t id;
+    };
+
+    //! packs many small surfaces into a few large StaticTexture pages
+    /*!
+     * each page is packed with the skyline bottom-left heuristic and keeps
+     * a Bpp4Surface copy of its pixels, so insertions upload only the new
+     * rectangle and repack() can rebuild the pages without the original
+     * surfaces. Drawing everything from a few pages keeps RenderBatch runs
+     * long.
+     *
+     * AtlasRegion handles stay valid across repack(); only the page and
+     * rectangle they resolve to change.
+     */
+    class TextureAtlas {
+    public:
+        //! @param format a 4 byte per pixel format
+        //! @param padding empty pixels kept around every region, so linear
+        //!        filtering does not bleed neighbours in
+        TextureAtlas(Renderer& r, int pageWidth = 1024, int pageHeight = 1024,
+                     int padding = 1,
+                     PixelFormat format = DEFAULT_PIXEL_FORMAT);
+
+        //! copy s into the atlas, converted to the page format
+        //! @throw TooLarge if s does not fit on an empty page
+        AtlasRegion insert(Surface& s);
+        //! the space is reclaimed by the next repack(), the id by the next
+        //! insert(), so region must not be used afterwards
+        void erase(AtlasRegion region);
+        //! pack the live regions again, largest first, freeing unused pages
+        void repack();
+
+        Texture& texture(AtlasRegion region);
+        Rectangle rect(AtlasRegion region) const;
+
+        std::size_t pages() const;
+        //! live region area divided by the total page area, 0 to 1
+        double occupancy() const;
+
+        //! blend mode of all pages, BlendMode::Blend by default
+        void setBlendMode(BlendMode::type m);
+
+        struct TooLarge : public error::RuntimeError {
+            using error::RuntimeError::RuntimeError;
+        };
+    private:
+        struct Node {
+            int x, y, w;
+        };
+        struct Page {
+            Page(Renderer& r, int w, int h, PixelFormat format);
+            StaticTexture texture;
+            Bpp4Surface pixels;
+            std::vector<Node> skyline;
+        };
+        struct Entry {
+            int page;
+            Rectangle rect;
+            bool live;
+        };
+        Renderer& renderer;
+        int pageWidth, pageHeight, padding;
+        PixelFormat format;
+        BlendMode::type blendMode;
+        std::vector<std::unique_ptr<Page>> book;
+        std::vector<Entry> entries;
+        //! ids of erased entries, reused before entries grows
+        std::vector<std::uint32_t> freeIds;
+        std::size_t liveArea;
+
+        Entry& entry(AtlasRegion region);
+        const Entry& entry(AtlasRegion region) const;
+        static bool fit(std::vector<Node>& skyline, int w, int h, int width,
+                        int height, Position *pos);
+        Page& newPage();
+        //! find room for w x h pixels, adding a page when needed
+        int place(int w, int h, Position *pos);
+    };
+
+    //! decodes images on a ThreadPool and hands them over a few per frame
+    /*!
+     * decode() returns a future for code that can block; load() calls
+     * back from dispatch(), which the render loop calls once per frame
+     * with a time budget, so creating textures stays on the rendering
+     * thread and presenting goes on while the pool decodes.
+     *
+     * load(), dispatch() and pending() belong to one thread. Decodes
+     * still running when the loader is destroyed are finished and dropped.
+     */
+    class ImageLoader {
+    public:
+        typedef std::function<void(Surface&)> OnSurface;
+        //! the texture may be moved from
+        typedef std::function<void(Texture&)> OnTexture;
+        typedef std::function<void(const std::string& path)> OnError;
+
+        /*!
+         * @param format decoded images are converted to it on the pool, so
+         *        nothing is converted again at upload, or
+         *        SDL_PIXELFORMAT_UNKNOWN to keep what the file has
+         */
+        explicit ImageLoader(ThreadPool& pool,
+                             PixelFormat format = SDL_PIXELFORMAT_UNKNOWN);
+        ImageLoader(const ImageLoader&) = delete;
+        ImageLoader& operator=(const ImageLoader&) = delete;
+
+        //! @throw Surface::LoadFailure from get() when decoding fails
+        std::future<Surface> decode(const std::string& path);
+
+        void load(const std::string& path, OnSurface done,
+                  OnError failed = OnError());
+        //! like above, the texture is created in dispatch()
+        void load(const std::string& path, Renderer& r, OnTexture done,
+                  OnError failed = OnError());
+
+        /*!
+         * run the callbacks of decoded images until budget has passed,
+         * at least one when any image is ready
+         * @return number of callbacks run
+         */
+        std::size_t dispatch(std::chrono::microseconds budget);
+
+        //! loads whose callbacks have not run yet
+        std::size_t pending() const;
+    private:
+        struct Decoded {
+            std::unique_ptr<Surface> surface;
+            std::string path;
+            OnSurface done;
+            OnError failed;
+        };
+        //! outlives the loader while tasks are queued
+        struct Shared {
+            std::mutex lock;
+            std::deque<Decoded> ready;
+        };
+        ThreadPool& pool;
+        PixelFormat format;
+        std::shared_ptr<Shared> shared;
+        std::size_t loading;
+
+        static Surface read(const std::string& path, PixelFormat format);
+    };
+
+    //! a whole file mapped into memory
+    class MappedFile {
+        const void *bytes;
+        std::size_t length;
+    public:
+        struct Mode {
+            enum type {
+                ReadOnly,
+                //! writable, writes go to private copies of the pages and
+                //! never to the file
+                CopyOnWrite
+            };
+        };
+        //! @throw OpenFailure
+        explicit MappedFile(const std::string& path,
+                            Mode::type mode = Mode::ReadOnly);
+        ~MappedFile();
+        MappedFile(MappedFile&& f);
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MemoryRegion region() const;
+
+        struct OpenFailure : public error::RuntimeError {
+            using error::RuntimeError::RuntimeError;
+        };
+    };
+
+    //! many named files in one mapped file
+    /*!
+     * the layout, all integers little endian:
+     *
+     *     "SDLPPPK1" u32 count
+     *     count times: u32 name length, name bytes, u64 offset, u64 size
+     *     file data, each starting at a multiple of 16
+     *
+     * get() is a lookup in the index, the bytes are read straight from
+     * the page cache. PackWriter makes such files.
+     */
+    class PackFile {
+        MappedFile file;
+        std::unordered_map<std::string, MemoryRegion> index;
+    public:
+        //! @throw MappedFile::OpenFailure, FormatError
+        explicit PackFile(const std::string& path);
+
+        bool contains(const std::string& name) const;
+        //! @throw NotFound
+        MemoryRegion get(const std::string& name) const;
+        std::vector<std::string> names() const;
+
+        Surface loadBMP(const std::string& name) const;
+        Surface loadIMG(const std::string& name) const;
+
+        struct FormatError : public error::RuntimeError {
+            using error::RuntimeError::RuntimeError;
+        };
+        struct NotFound : public error::RuntimeError {
+            using error::RuntimeError::RuntimeError;
+        };
+    };
+
+    class SurfaceCache;
+
+    //! a Surface whose pixels may be mapped from a SurfaceCache file
+    /*!
+     * the mapping lives as long as this object, keep it around while the
+     * surface is used and do not move the Surface out of it
+     */
+    class CachedSurface {
+        friend SurfaceCache;
+        //! destroyed after the SDL_Surface, which does not own the pixels
+        std::unique_ptr<MappedFile> file;
+        Surface image;
+        CachedSurface(SDL_Surface *s, std::unique_ptr<MappedFile> f);
+        explicit CachedSurface(Surface&& s);
+    public:
+        CachedSurface(CachedSurface&& s);
+        Surface& surface();
+        const Surface& surface() const;
+        //! whether the pixels came from the cache
+        bool mapped() const;
+    };
+
+    //! keeps decoded and converted images on disk, keyed by content
+    /*!
+     * load() hashes the encoded bytes; when the cache directory has a
+     * surface for that hash and format, its pixels are mapped copy on
+     * write and wrapped with SDL_CreateRGBSurfaceFrom(), so neither
+     * decoding nor conversion happens. Otherwise the image is decoded,
+     * converted and written for the next time.
+     *
+     * Cache files hold native endian pixels and are not meant to move
+     * between machines. A cache that can not be written only costs the
+     * speed up.
+     */
+    class SurfaceCache {
+        std::string dir;
+        PixelFormat format;
+        std::size_t hitCount, missCount;
+
+        std::string entry(std::uint64_t key) const;
+    public:
+        //! @param directory an existing directory
+        explicit SurfaceCache(const std::string& directory,
+                              PixelFormat format = DEFAULT_PIXEL_FORMAT);
+
+        //! @throw Surface::LoadFailure if a miss can not be decoded
+        CachedSurface load(MemoryRegion encoded);
+        //! maps the encoded file at path for hashing
+        CachedSurface load(const std::string& path);
+
+        //! where the surface of encoded is cached, e.g. to remove it
+        std::string entry(MemoryRegion encoded) const;
+
+        std::size_t hits() const;
+        std::size_t misses() const;
+    };
+
+    //! collects files and writes them as a PackFile
+    class PackWriter {
+        std::vector<std::pair<std::string, std::string>> files;
+    public:
+        //! data is copied
+        void add(const std::string& name, MemoryRegion data);
+        //! @throw MappedFile::OpenFailure
+        void addFile(const std::string& name, const std::string& path);
+        //! @throw error::RuntimeError when path can not be written
+        void write(const std::string& path) const;
+    };
+
+    //! size, pixel format and texture access of pooled objects
+    struct PoolKey {
+        int width, height;
+        PixelFormat format;
+        int access;     //!< SDL_TextureAccess, for surfaces their class
+        bool operator==(const PoolKey& k) const;
+        //! pixel bytes, what the capacity of a pool counts
+        std::size_t bytes() const;
+    };
+
+    struct PoolKeyHash {
+        std::size_t operator()(const PoolKey& k) const;
+    };
+
+    template<typename T>
+    class ObjectPool;
+
+    //! an object borrowed from an ObjectPool, given back when destroyed
+    /*!
+     * T may be derived from what the pool holds, e.g. a TargetTexture of
+     * a TexturePool. The pool must outlive its handles.
+     */
+    template<typename T, typename Base = T>
+    class PoolHandle {
+        friend class ObjectPool<Base>;
+        typedef typename ObjectPool<Base>::Owned Owned;
+        ObjectPool<Base> *pool;
+        PoolKey key;
+        Owned object;
+        PoolHandle(ObjectPool<Base> *p, const PoolKey& k, Owned o);
+    public:
+        PoolHandle(PoolHandle&& h);
+        ~PoolHandle();
+        PoolHandle(const PoolHandle&) = delete;
+        PoolHandle& operator=(const PoolHandle&) = delete;
+
+        T& operator*() const;
+        T* operator->() const;
+    };
+
+    //! recycles objects by PoolKey instead of freeing them
+    /*!
+     * given back objects wait idle in the bucket of their key, and
+     * acquiring takes the most recently given back one. When the idle
+     * objects take more bytes than the capacity, the least recently given
+     * back are freed; objects in use do not count. Not thread safe.
+     */
+    template<typename T>
+    class ObjectPool {
+        template<typename, typename> friend class PoolHandle;
+    public:
+        typedef std::unique_ptr<T, void (*)(T*)> Owned;
+
+        explicit ObjectPool(std::size_t capacity);
+        ObjectPool(const ObjectPool&) = delete;
+        ObjectPool& operator=(const ObjectPool&) = delete;
+
+        //! free idle objects until they fit into bytes
+        void setCapacity(std::size_t bytes);
+        std::size_t capacity() const;
+        //! bytes taken by idle objects
+        std::size_t idleBytes() const;
+        std::size_t hits() const;
+        std::size_t misses() const;
+        //! free all idle objects
+        void clear();
+    protected:
+        //! an idle object of key k, or a new one from create()
+        //! @param create returns a new U, which is T or derived from it
+        template<typename U, typename Create>
+        PoolHandle<U, T> acquire(const PoolKey& k, Create create);
+    private:
+        struct Idle {
+            Owned object;
+            std::uint64_t stamp;    //!< when it was given back
+        };
+        std::unordered_map<PoolKey, std::vector<Idle>, PoolKeyHash> buckets;
+        std::size_t cap, idle, hitCount, missCount;
+        std::uint64_t clock;
+
+        void release(const PoolKey& k, Owned object);
+        void trim(std::size_t bytes);
+        template<typename U>
+        static void destroy(T *object);
+    };
+
+    //! recycles scratch surfaces of the same size and format
+    class SurfacePool : public ObjectPool<Surface> {
+    public:
+        explicit SurfacePool(std::size_t capacity = 64 << 20);
+
+        //! the pixels and RLE are left by the previous user; the clip
+        //! rectangle, color key, dirty tracking, blend mode, alpha mod
+        //! and color mod are reset to those of a new surface
+        PoolHandle<Surface> acquire(int width, int height,
+                PixelFormat format = DEFAULT_PIXEL_FORMAT);
+        //! the same as a canvas, whose drawing color, blend mode, clip
+        //! rectangle and dirty tracking are reset like a new one's too
+        //! @throw error::RuntimeError unless format has 4 byte pixels
+        PoolHandle<Bpp4Surface, Surface> acquireBpp4(int width, int height,
+                PixelFormat format = DEFAULT_PIXEL_FORMAT);
+    private:
+        //! PoolKey::access of each class, so a bucket holds only one
+        enum { Plain, Bpp4 };
+
+        static void reset(Surface& s);
+    };
+
+    //! recycles textures of the same size, format and access
+    class TexturePool : public ObjectPool<Texture> {
+    public:
+        explicit TexturePool(Renderer& r, std::size_t capacity = 64 << 20);
+
+        //! the pixels are left by the previous user, color mod, alpha
+        //! mod and blend mode are reset to white, 255 and none
+        PoolHandle<TargetTexture, Texture> acquireTarget(int width,
+                int height, PixelFormat format = DEFAULT_PIXEL_FORMAT);
+        PoolHandle<StaticTexture, Texture> acquireStatic(int width,
+                int height, PixelFormat format = DEFAULT_PIXEL_FORMAT);
+        PoolHandle<StreamingTexture, Texture> acquireStreaming(int width,
+                int height, PixelFormat format = DEFAULT_PIXEL_FORMAT);
+    private:
+        Renderer& renderer;
+
+        template<typename U>
+        PoolHandle<U, Texture> take(int width, int height,
+                PixelFormat format, SDL_TextureAccess access);
+    };
+
+    //! main loop with a fixed update rate and a paced frame rate
+    /*!
+     * every frame calls input() once, update(dt) as often as the time
+     * passed asks for at the fixed update rate, and render(alpha) once,
+     * alpha in [0, 1) telling how far the present lies between the last
+     * update and the next one, for interpolating positions. When updates
+     * fall more than maxUpdates behind, the backlog is dropped instead of
+     * spiralling.
+     *
+     * Frames are paced to the frame rate with SDL_Delay() until shortly
+     * before the deadline and a spin on SDL_GetPerformanceCounter() for
+     * the rest. The sleep margin follows the oversleep observed, so the
+     * spin stays short on systems with precise timers. A frame rate of 0
+     * leaves pacing to e.g. vsync in Renderer::present().
+     */
+    class FrameLoop {
+    public:
+        typedef std::function<void()> Input;
+        typedef std::function<void(double dt)> Update;
+        typedef std::function<void(double alpha)> Render;
+
+        //! frame times in seconds, measured from frame start to start
+        struct Stats {
+            std::uint64_t frames;
+            std::uint64_t updates;
+            std::uint64_t droppedUpdates;
+            double last;
+            double average;     //!< moving average of the last ~16 frames
+            double worst;
+        };
+
+        //! @param input may be empty, update and render may not
+        //! @throw error::RuntimeError if updateRate is not positive,
+        //!        maxUpdates is 0 or update or render is empty
+        FrameLoop(Input input, Update update, Render render,
+                  double updateRate = 60, double frameRate = 60,
+                  unsigned maxUpdates = 5);
+
+        //! call frame() until stop()
+        void run();
+        //! one paced frame
+        void frame();
+        //! makes run() return after the current frame
+        void stop();
+
+        void setFrameRate(double hz);
+        const Stats& stats() const;
+        void resetStats();
+    private:
+        Input input;
+        Update update;
+        Render render;
+        std::uint64_t frequency;
+        double step;            //!< update period in counter ticks
+        double period;          //!< frame period in counter ticks, 0 unpaced
+        unsigned maxUpdates;
+        bool running, started;
+        std::uint64_t origin;   //!< counter at the first frame
+        std::uint64_t last;     //!< start of the previous frame
+        double accumulator;     //!< ticks not yet consumed by updates
+        double deadline;        //!< next frame start, ticks after origin
+        double margin;          //!< ticks kept for spinning after a sleep
+        Stats counters;
+
+        //! ticks since origin
+        double elapsed() const;
+        void pace();
     };
 
     //! represent a GUI %window instance
@@ -585,6 +2279,10 @@ namespace sdlpp {
         //! copy the window surface to the screen
         void update();
 
+        //! copy only the rectangles of region in the window surface to
+        //! the screen, nothing if region is empty
+        void update(const DirtyRegion& region);
+
         //! restore size and position after a minimized or maximized window
         void restore();
 
@@ -669,26 +2367,35 @@ namespace sdlpp {
         template<typename T>
             EventBase<T>::EventBase(const T* p) : ptr(p) {}
 
-        inline EventHandler::EventHandler() : ptr() {}
+        inline EventHandler::EventHandler() : event(), valid(false) {}
         inline EventHandler::EventHandler(EventHandler&& e)
-            : ptr(std::move(e.ptr)) {}
+            : event(e.event), valid(e.valid) {
+            e.valid = false;
+        }
 
         inline EventHandler& EventHandler::operator=(EventHandler&& e) {
-            ptr = std::move(e.ptr);
+            event = e.event;
+            valid = e.valid;
+            if (&e != this) e.valid = false;
             return *this;
         }
 
+        inline const SDL_Event* EventHandler::get() const {
+            if (!valid) throw DereferenceFailure();
+            return &event;
+        }
+
         template<EventType::type t>
         const Event<t> EventHandler::acquire() const {
-            if (ptr) {
-                return Event<t>::extract(ptr.get());
-            } else {
-                throw DereferenceFailure();
-            }
+            return Event<t>::extract(get());
         }
 
         inline EventType::type EventHandler::type() const {
-            switch (ptr->type) {
+            return typeOf(*get());
+        }
+
+        inline EventType::type typeOf(const SDL_Event& e) {
+            switch (e.type) {
                 case SDL_WINDOWEVENT:
                     return EventType::Window;
                 case SDL_QUIT:
@@ -696,32 +2403,110 @@ namespace sdlpp {
                 case SDL_KEYDOWN:
                 case SDL_KEYUP:
                     return EventType::Keyboard;
+                case SDL_TEXTEDITING:
+                    return EventType::TextEditing;
+                case SDL_MOUSEMOTION:
+                    return EventType::MouseMotion;
+                case SDL_MOUSEBUTTONDOWN:
+                case SDL_MOUSEBUTTONUP:
+                    return EventType::MouseButton;
+                case SDL_MOUSEWHEEL:
+                    return EventType::MouseWheel;
                 default:
-                    return EventType::Window;
+                    if (e.type >= SDL_USEREVENT && e.type < SDL_LASTEVENT) {
+                        return EventType::User;
+                    }
+                    return EventType::Unknown;
             }
         }
 
-        inline Timestamp EventHandler::timestamp() const {
-            if (ptr) {
-                return ptr->common.timestamp;
-            } else {
-                throw DereferenceFailure();
-            }
+        template<typename T>
+        MessageQueue<T>::MessageQueue() : head(new Node()), signalled(false) {
+            tail = head.load();
         }
 
-        inline EventHandler EventHandler::create(SDL_Event*e) {
-            return EventHandler(e);
+        template<typename T>
+        MessageQueue<T>::~MessageQueue() {
+            drain([](T&) {});
+            delete tail;
         }
 
-        inline SDL_WindowEventID Event<EventType::Window>::getID() const {
-            return (SDL_WindowEventID)ptr->event;
+        template<typename T>
+        void MessageQueue<T>::push(T message) {
+            Node *n = new Node();
+            new (&n->value) T(std::move(message));
+            // the node is visible to the consumer once linked
+            Node *prev = head.exchange(n, std::memory_order_acq_rel);
+            prev->next.store(n, std::memory_order_release);
+            if (!signalled.exchange(true, std::memory_order_acq_rel)) {
+                SDL_Event e;
+                SDL_zero(e);
+                e.type = messageEventType();
+                e.user.data1 = this;
+                if (SDL_PushEvent(&e) != 1) {
+                    signalled.store(false);
+                }
+            }
         }
 
-        inline bool Event<EventType::Keyboard>::pressed() const {
-            return ptr->state == SDL_PRESSED;
+        template<typename T>
+        template<typename F>
+        std::size_t MessageQueue<T>::drain(F f) {
+            // rearm first: a push after this point signals again, a push
+            // before it was linked before its signal, so it is seen below
+            signalled.exchange(false, std::memory_order_acq_rel);
+            std::size_t n = 0;
+            for (;;) {
+                Node *next = tail->next.load(std::memory_order_acquire);
+                if (!next) break;
+                delete tail;
+                tail = next;
+                T message(std::move(*next->get()));
+                next->get()->~T();
+                n++;
+                f(message);
+            }
+            return n;
         }
 
-        inline bool Event<EventType::Keyboard>::repeat() const {
+        template<typename T>
+        bool MessageQueue<T>::wakes(const SDL_Event& e) const {
+            return e.type == messageEventType() && e.user.data1 == this;
+        }
+
+        template<std::size_t Capacity>
+        std::size_t EventBatch<Capacity>::drain() {
+            count = event::drain(events, Capacity);
+            return count;
+        }
+
+        template<std::size_t Capacity>
+        template<EventType::type T, typename F>
+        void EventBatch<Capacity>::each(F f) const {
+            for (std::size_t i = 0; i < count; i++) {
+                if (typeOf(events[i]) == T) {
+                    f(Event<T>::extract(&events[i]));
+                }
+            }
+        }
+
+        inline Timestamp EventHandler::timestamp() const {
+            return get()->common.timestamp;
+        }
+
+        inline EventHandler EventHandler::create(const SDL_Event& e) {
+            return EventHandler(e);
+        }
+
+        inline SDL_WindowEventID Event<EventType::Window>::getID() const {
+            return (SDL_WindowEventID)ptr->event;
+        }
+
+        inline bool Event<EventType::Keyboard>::pressed() const {
+            return ptr->state == SDL_PRESSED;
+        }
+
+        inline bool Event<EventType::Keyboard>::repeat() const {
             return ptr->repeat != 0;
         }
 
@@ -742,6 +2527,136 @@ namespace sdlpp {
         Event<EventType::Keyboard>::extract(const SDL_Event* e) {
             return Event(&e->key);
         }
+
+        inline const Event<EventType::TextEditing>
+        Event<EventType::TextEditing>::extract(const SDL_Event* e) {
+            return Event(&e->edit);
+        }
+        inline const char *Event<EventType::TextEditing>::text() const {
+            return ptr->text;
+        }
+        inline int Event<EventType::TextEditing>::start() const {
+            return ptr->start;
+        }
+        inline int Event<EventType::TextEditing>::length() const {
+            return ptr->length;
+        }
+
+        inline const Event<EventType::MouseMotion>
+        Event<EventType::MouseMotion>::extract(const SDL_Event* e) {
+            return Event(&e->motion);
+        }
+        inline int Event<EventType::MouseMotion>::x() const { return ptr->x; }
+        inline int Event<EventType::MouseMotion>::y() const { return ptr->y; }
+        inline int Event<EventType::MouseMotion>::xrel() const {
+            return ptr->xrel;
+        }
+        inline int Event<EventType::MouseMotion>::yrel() const {
+            return ptr->yrel;
+        }
+        inline std::uint32_t Event<EventType::MouseMotion>::buttons() const {
+            return ptr->state;
+        }
+
+        inline const Event<EventType::MouseButton>
+        Event<EventType::MouseButton>::extract(const SDL_Event* e) {
+            return Event(&e->button);
+        }
+        inline std::uint8_t Event<EventType::MouseButton>::button() const {
+            return ptr->button;
+        }
+        inline bool Event<EventType::MouseButton>::pressed() const {
+            return ptr->state == SDL_PRESSED;
+        }
+        inline std::uint8_t Event<EventType::MouseButton>::clicks() const {
+            return ptr->clicks;
+        }
+        inline int Event<EventType::MouseButton>::x() const { return ptr->x; }
+        inline int Event<EventType::MouseButton>::y() const { return ptr->y; }
+
+        inline const Event<EventType::MouseWheel>
+        Event<EventType::MouseWheel>::extract(const SDL_Event* e) {
+            return Event(&e->wheel);
+        }
+        inline int Event<EventType::MouseWheel>::x() const {
+#if SDL_VERSION_ATLEAST(2, 0, 4)
+            if (ptr->direction == SDL_MOUSEWHEEL_FLIPPED) return -ptr->x;
+#endif
+            return ptr->x;
+        }
+        inline int Event<EventType::MouseWheel>::y() const {
+#if SDL_VERSION_ATLEAST(2, 0, 4)
+            if (ptr->direction == SDL_MOUSEWHEEL_FLIPPED) return -ptr->y;
+#endif
+            return ptr->y;
+        }
+
+        inline const Event<EventType::Quit>
+        Event<EventType::Quit>::extract(const SDL_Event* e) {
+            return Event(&e->quit);
+        }
+
+        inline const Event<EventType::User>
+        Event<EventType::User>::extract(const SDL_Event* e) {
+            return Event(&e->user);
+        }
+        inline std::uint32_t Event<EventType::User>::kind() const {
+            return ptr->type;
+        }
+        inline std::int32_t Event<EventType::User>::code() const {
+            return ptr->code;
+        }
+        inline void *Event<EventType::User>::data1() const {
+            return ptr->data1;
+        }
+        inline void *Event<EventType::User>::data2() const {
+            return ptr->data2;
+        }
+
+        inline const Event<EventType::Unknown>
+        Event<EventType::Unknown>::extract(const SDL_Event* e) {
+            return Event(&e->common);
+        }
+        inline std::uint32_t Event<EventType::Unknown>::kind() const {
+            return ptr->type;
+        }
+
+        template<typename... Handlers>
+        Dispatcher<Handlers...>::Dispatcher(Handlers... hs) : handlers(hs...) {}
+
+        template<typename... Handlers>
+        template<EventType::type T>
+        bool Dispatcher<Handlers...>::call(Dispatcher& d, const SDL_Event& e) {
+            return invoke<T>(d, e, std::integral_constant<std::size_t,
+                    detail::Find<T, 0, Handlers...>::value>());
+        }
+
+        template<typename... Handlers>
+        template<std::size_t... Is>
+        const typename Dispatcher<Handlers...>::Entry *
+        Dispatcher<Handlers...>::table(detail::Indices<Is...>) {
+            // constant initialized, no guard on use
+            static const Entry entries[] = {
+                &call<static_cast<EventType::type>(Is)>...
+            };
+            return entries;
+        }
+
+        template<typename... Handlers>
+        bool Dispatcher<Handlers...>::operator()(const SDL_Event& e) {
+            typedef typename detail::MakeIndices<EventType::count>::type all;
+            return table(all())[typeOf(e)](*this, e);
+        }
+
+        template<typename... Handlers>
+        bool Dispatcher<Handlers...>::operator()(const EventHandler& e) {
+            return (*this)(*e.get());
+        }
+
+        template<typename... Handlers>
+        Dispatcher<Handlers...> makeDispatcher(Handlers... hs) {
+            return Dispatcher<Handlers...>(hs...);
+        }
     }
 
 
@@ -779,43 +2694,96 @@ namespace sdlpp {
         o.ptr = nullptr;
     }
 
-    inline Renderer::Renderer(SDL_Renderer* p) : PointerHolder(p) {}
+    inline Renderer::Renderer(SDL_Renderer* p)
+        : PointerHolder(p), drawColor(0), drawColorKnown(false),
+          counters() {}
     inline Renderer::~Renderer() { SDL_DestroyRenderer(ptr); }
-    inline Renderer::Renderer(Renderer&& r) : PointerHolder((PointerHolder&&)r) { }
-    inline void Renderer::clear() { if (SDL_RenderClear(ptr)) THROW_SDLPP_RUNTIME_ERROR(); }
-    inline void Renderer::present() { SDL_RenderPresent(ptr); }
+    inline Renderer::Renderer(Renderer&& r)
+        : PointerHolder((PointerHolder&&)r), drawColor(r.drawColor),
+          drawColorKnown(r.drawColorKnown), counters(r.counters) { }
+    inline void Renderer::invalidate() { drawColorKnown = false; }
+    inline const StateStats& Renderer::stats() const { return counters; }
+    inline void Renderer::clear() {
+        SDLPP_COUNT(DrawCalls, 1);
+        if (SDL_RenderClear(ptr)) THROW_SDLPP_RUNTIME_ERROR();
+    }
+    inline void Renderer::present() {
+        SDLPP_ZONE("Renderer::present");
+        SDL_RenderPresent(ptr);
+    }
 
     inline Surface::Surface(SDL_Surface *p, bool managed)
-        : PointerHolder(p), needDeallocate(!managed) {}
+        : PointerHolder(p), needDeallocate(!managed), dirty(nullptr) {}
     inline Surface::~Surface() { if (needDeallocate) { SDL_FreeSurface(ptr); } }
     inline Surface::Surface(Surface&& s): PointerHolder((PointerHolder&&)s),
-                                 needDeallocate(s.needDeallocate) {}
+                                 needDeallocate(s.needDeallocate),
+                                 dirty(s.dirty) {}
+    inline void Surface::trackDirty(DirtyRegion *region) { dirty = region; }
     inline SDL_PixelFormat *Surface::getFormat() { return ptr->format; }
     inline Surface Surface::convert(const SDL_PixelFormat *format) {
         SDL_Surface *newsuf = SDL_ConvertSurface(ptr,
                 const_cast<SDL_PixelFormat*>(format), 0);
         if (!newsuf) throw ConvertFailure();
+        SDLPP_COUNT(Allocations, 1);
         return Surface(newsuf);
     }
 
 
     inline Texture::Texture(Renderer& r, Surface& s) :
-        PointerHolder(SDL_CreateTextureFromSurface(r.get(), s.get()))
+        PointerHolder(SDL_CreateTextureFromSurface(r.get(), s.get())),
+        colorMod(0), alphaMod(0), blendMode(BlendMode::None), known(0),
+        counters()
     {
         if (!ptr) { THROW_SDLPP_RUNTIME_ERROR(); }
+        SDLPP_COUNT(Allocations, 1);
     }
 
     inline Texture::Texture(Renderer& r, Surface&& s) :
-        PointerHolder(SDL_CreateTextureFromSurface(r.get(), s.get()))
+        PointerHolder(SDL_CreateTextureFromSurface(r.get(), s.get())),
+        colorMod(0), alphaMod(0), blendMode(BlendMode::None), known(0),
+        counters()
     {
         if (!ptr) { THROW_SDLPP_RUNTIME_ERROR(); }
+        SDLPP_COUNT(Allocations, 1);
     }
 
     inline Texture::~Texture() { SDL_DestroyTexture(ptr); }
     inline Window::Window(SDL_Window* p) : PointerHolder(p) {}
     inline Window::Window(Window&& w) : PointerHolder((PointerHolder&&)w) {}
-    inline Texture::Texture(Texture&& t) : PointerHolder((PointerHolder&&)t) {}
+    inline Texture::Texture(Texture&& t)
+        : PointerHolder((PointerHolder&&)t), colorMod(t.colorMod),
+          alphaMod(t.alphaMod), blendMode(t.blendMode), known(t.known),
+          counters(t.counters) {}
+    inline void Texture::invalidate() { known = 0; }
+    inline const StateStats& Texture::stats() const { return counters; }
+
+    //! count a setter call, @return whether it has to reach SDL
+    inline bool Texture::changes(unsigned what, bool same) {
+        if ((known & what) && same) {
+            counters.elided++;
+            return false;
+        }
+        counters.issued++;
+        return true;
+    }
     inline void Window::update() { SDL_UpdateWindowSurface(ptr); }
+    inline void Window::update(const DirtyRegion& region) {
+        static_assert(sizeof(Rectangle) == sizeof(SDL_Rect),
+                      "Rectangle must be layout compatible with SDL_Rect");
+        if (region.empty()) return;
+        if (SDL_UpdateWindowSurfaceRects(ptr, region.rects().data(),
+                    (int)region.rects().size()) < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+    }
+
+    inline DirtyRegion::DirtyRegion(std::size_t n)
+        : capacity(std::max<std::size_t>(n, 1)) {}
+    inline const std::vector<Rectangle>& DirtyRegion::rects() const {
+        return list;
+    }
+    inline bool DirtyRegion::empty() const { return list.empty(); }
+    inline void DirtyRegion::clear() { list.clear(); }
     inline Surface Window::getSurface() { return Surface(SDL_GetWindowSurface(ptr), true); }
 
     inline Renderer Window::getRenderer() {
@@ -845,240 +2813,851 @@ namespace sdlpp {
     inline Initializer::Initializer(std::uint32_t v) : value(v) {}
 
     inline void Renderer::setDrawColor(const Color& color) {
+        std::uint32_t packed = ((std::uint32_t)color.red << 24) |
+            (color.green << 16) | (color.blue << 8) | color.alpha;
+        if (drawColorKnown && drawColor == packed) {
+            counters.elided++;
+            return;
+        }
+        counters.issued++;
+        drawColorKnown = false;
         if (SDL_SetRenderDrawColor(ptr, color.red, color.green, color.blue,
                    color.alpha) < 0) {
             THROW_SDLPP_RUNTIME_ERROR();
         }
+        drawColor = packed;
+        drawColorKnown = true;
     }
 
     inline void Renderer::fillRectangle(const Rectangle& rect) {
+        SDLPP_COUNT(DrawCalls, 1);
         if (SDL_RenderFillRect(ptr, &rect) < 0) {
             THROW_SDLPP_RUNTIME_ERROR();
         }
     }
 
     inline void Renderer::drawLine(Position a, Position b) {
+        SDLPP_COUNT(DrawCalls, 1);
         if (SDL_RenderDrawLine(ptr, a.x, a.y, b.x, b.y) < 0) {
             THROW_SDLPP_RUNTIME_ERROR();
         }
     }
 
-    inline void Renderer::drawPoint(Position p) {
-        if (SDL_RenderDrawPoint(ptr, p.x, p.y) < 0) {
-            THROW_SDLPP_RUNTIME_ERROR();
-        }
+    inline void Renderer::drawPoint(Position p) {
+        SDLPP_COUNT(DrawCalls, 1);
+        if (SDL_RenderDrawPoint(ptr, p.x, p.y) < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+    }
+
+    inline int Surface::width() const {
+        return ptr->w;
+    }
+
+    inline int Surface::height() const {
+        return ptr->h;
+    }
+
+    inline void Surface::setColorKey(const Color& c) {
+        if (SDL_SetColorKey(ptr, true,
+                    SDL_MapRGB(getFormat(), c.red, c.green, c.blue)) < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+    }
+
+    inline void Surface::unsetColorKey(const Color& c) {
+        if (SDL_SetColorKey(ptr, false,
+                    SDL_MapRGB(getFormat(), c.red, c.green, c.blue)) < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+    }
+
+
+    inline Color::Color(std::uint8_t r, std::uint8_t g,
+          std::uint8_t b, std::uint8_t a)
+        : red(r), green(g), blue(b), alpha(a) { }
+
+    inline void Texture::setColorMod(const Color& color) {
+        std::uint32_t packed = ((std::uint32_t)color.red << 16) |
+            (color.green << 8) | color.blue;
+        if (!changes(ColorModKnown, colorMod == packed)) return;
+        known &= ~ColorModKnown;
+        if (SDL_SetTextureColorMod(ptr, color.red, color.green, color.blue)
+               < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+        colorMod = packed;
+        known |= ColorModKnown;
+    }
+
+    inline void Window::restore() { SDL_RestoreWindow(ptr); }
+    inline Texture::Texture(SDL_Texture* t)
+        : PointerHolder(t), colorMod(0), alphaMod(0),
+          blendMode(BlendMode::None), known(0), counters() {}
+
+    inline void Renderer::setTarget(TargetTexture* texture) {
+        // SDL itself drops a destroyed target, so ask it rather than
+        // remembering a pointer which may be reused
+        SDL_Texture *t = texture ? texture->get() : nullptr;
+        if (SDL_GetRenderTarget(ptr) == t) {
+            counters.elided++;
+            return;
+        }
+        counters.issued++;
+        if (SDL_SetRenderTarget(ptr, t) <0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+    }
+
+    inline StaticTexture Renderer::spawnStatic(int width, int height,
+                                                 PixelFormat format) {
+        return createTexture<StaticTexture>(format, SDL_TEXTUREACCESS_STATIC,
+                width, height);
+    }
+
+    inline StreamingTexture Renderer::spawnStreaming(
+            int width, int height, PixelFormat format) {
+        return createTexture<StreamingTexture>(format, SDL_TEXTUREACCESS_STREAMING,
+                width, height);
+    }
+
+    inline TargetTexture Renderer::spawnTarget(
+            int width, int height, PixelFormat format) {
+        return createTexture<TargetTexture>(format, SDL_TEXTUREACCESS_TARGET,
+                width, height);
+    }
+
+    template<typename T>
+    inline T Renderer::createTexture(PixelFormat format,
+            SDL_TextureAccess access, int width, int height) {
+        auto tp = SDL_CreateTexture(ptr, format, access, width, height);
+        if (!tp) { THROW_SDLPP_RUNTIME_ERROR(); }
+        SDLPP_COUNT(Allocations, 1);
+        return T(tp);
+    }
+
+    inline void Texture::setAlphaMod(std::uint8_t alpha) {
+        if (!changes(AlphaModKnown, alphaMod == alpha)) return;
+        known &= ~AlphaModKnown;
+        if (SDL_SetTextureAlphaMod(ptr, alpha) < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+        alphaMod = alpha;
+        known |= AlphaModKnown;
+    }
+
+    inline void Texture::setBlendMode(BlendMode::type m) {
+        if (!changes(BlendModeKnown, blendMode == m)) return;
+        known &= ~BlendModeKnown;
+        if (SDL_SetTextureBlendMode(ptr, (SDL_BlendMode)m) < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+        blendMode = m;
+        known |= BlendModeKnown;
+    }
+
+    inline SDL_RendererFlip Renderer::horizontalFlip() {
+        return SDL_FLIP_HORIZONTAL;
+    }
+
+    inline SDL_RendererFlip Renderer::verticalFlip() {
+        return SDL_FLIP_VERTICAL;
+    }
+
+    inline void Renderer::copy(Texture& texture, const double angle,
+            const Rectangle* srcrect,
+            const Rectangle* destrect,
+            const Position* center,
+            SDL_RendererFlip flip) {
+        SDLPP_COUNT(DrawCalls, 1);
+        SDLPP_TEXTURE(texture.get());
+        if (SDL_RenderCopyEx(ptr, texture.get(), srcrect, destrect, angle,
+                    center, flip) < 0) {
+           THROW_SDLPP_RUNTIME_ERROR();
+        }
+    }
+
+    inline TargetTexture::TargetTexture(SDL_Texture*p) : Texture(p) {}
+    inline StaticTexture::StaticTexture(SDL_Texture*p) : Texture(p) {}
+    inline StreamingTexture::StreamingTexture(SDL_Texture*p) : Texture(p) {}
+
+    inline StreamingTexture::Lock::Lock(SDL_Texture *t, SDL_PixelFormat *f,
+            void *pixels, int width, int height, int pitch)
+        : texture(t), format(f), view(pixels, width, height, pitch, f) {}
+    inline StreamingTexture::Lock::~Lock() {
+        if (texture) {
+            SDL_UnlockTexture(texture);
+            SDL_FreeFormat(format);
+        }
+    }
+    inline StreamingTexture::Lock::Lock(Lock&& l)
+        : texture(l.texture), format(l.format), view(l.view) {
+        l.texture = nullptr;
+    }
+    inline Bpp4View& StreamingTexture::Lock::canvas() { return view; }
+
+    inline PixelMask::PixelMask(PixelFormat format) {
+        if (SDL_FALSE == SDL_PixelFormatEnumToMasks(format,
+                    &bpp, &rmask, &gmask, &bmask, &amask)) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+    }
+
+    inline Surface::Surface(int width, int height, PixelFormat format)
+        : PointerHolder(nullptr), needDeallocate(true), dirty(nullptr) {
+        PixelMask mask(format);
+        auto s = SDL_CreateRGBSurface(0, width, height, mask.bpp,
+                mask.rmask, mask.gmask, mask.bmask, mask.amask);
+        if (!s) { THROW_SDLPP_RUNTIME_ERROR(); }
+        SDLPP_COUNT(Allocations, 1);
+        ptr = s;
+    }
+
+    inline Surface::Surface(int width, int height, const PixelMask& mask)
+        : PointerHolder(nullptr), needDeallocate(true), dirty(nullptr) {
+        auto s = SDL_CreateRGBSurface(0, width, height, mask.bpp,
+                mask.rmask, mask.gmask, mask.bmask, mask.amask);
+        if (!s) { THROW_SDLPP_RUNTIME_ERROR(); }
+        SDLPP_COUNT(Allocations, 1);
+        ptr = s;
+    }
+
+    inline PixelFormat Surface::format() {
+        return (PixelFormat)getFormat()->format;
+    }
+
+    inline PixelValue Color::mapRGBA(SDL_PixelFormat *format) {
+        return SDL_MapRGBA(format, red, green, blue, alpha);
+    }
+
+    inline PixelValue Color::mapRGB(SDL_PixelFormat *format) {
+        return SDL_MapRGB(format, red, green, blue);
+    }
+
+    inline void * Surface::pixels() { return ptr->pixels; }
+
+    template<typename T>
+    PixelRows<T> Surface::rows() {
+        return PixelRows<T>(ptr->pixels, ptr->pitch,
+                            ptr->w * Bpp() / sizeof(T), ptr->h);
+    }
+
+    inline SurfaceLock::SurfaceLock(Surface& s) : surface(s.get()) {
+        if (SDL_MUSTLOCK(surface) && SDL_LockSurface(surface) < 0) {
+            THROW_SDLPP_RUNTIME_ERROR();
+        }
+    }
+
+    inline SurfaceLock::~SurfaceLock() {
+        if (SDL_MUSTLOCK(surface)) {
+            SDL_UnlockSurface(surface);
+        }
+    }
+
+    inline void *SurfaceLock::pixels() { return surface->pixels; }
+
+    template<typename T>
+    PixelRows<T> SurfaceLock::rows() {
+        return PixelRows<T>(surface->pixels, surface->pitch,
+                surface->w * surface->format->BytesPerPixel / sizeof(T),
+                surface->h);
+    }
+    inline int Surface::Bpp() { return getFormat()->BytesPerPixel; }
+    inline int Surface::pitch() const { return ptr->pitch; }
+
+    template<typename Derived>
+    void Canvas<Derived>::drawPoint(Position pos) {
+        touch(pos.x, pos.y, pos.x, pos.y);
+        plot<true>(bounds(), pos.x, pos.y);
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::trackDirty(DirtyRegion *region) {
+        dirty = region;
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::touch(int xa, int ya, int xb, int yb) {
+        if (!dirty) return;
+        const Bounds box = bounds();
+        xa = std::max(xa, box.x0);
+        ya = std::max(ya, box.y0);
+        xb = std::min(xb, box.x1);
+        yb = std::min(yb, box.y1);
+        if (xa <= xb && ya <= yb) {
+            dirty->add(Rectangle(xb - xa + 1, yb - ya + 1, Position(xa, ya)));
+        }
+    }
+
+    template<typename Derived>
+    bool Canvas<Derived>::Bounds::contains(int x, int y) const {
+        return x >= x0 && x <= x1 && y >= y0 && y <= y1;
+    }
+
+    template<typename Derived>
+    int Canvas<Derived>::Bounds::overlap(int xa, int ya,
+                                         int xb, int yb) const {
+        if (xb < x0 || xa > x1 || yb < y0 || ya > y1) return 0;
+        if (xa >= x0 && xb <= x1 && ya >= y0 && yb <= y1) return 2;
+        return 1;
+    }
+
+    template<typename Derived>
+    typename Canvas<Derived>::Bounds Canvas<Derived>::bounds() {
+        Bounds b = { 0, 0, getWidth() - 1, getHeight() - 1 };
+        if (clipEnabled) {
+            b.x0 = std::max(b.x0, clip.x);
+            b.y0 = std::max(b.y0, clip.y);
+            b.x1 = std::min(b.x1, clip.x + clip.w - 1);
+            b.y1 = std::min(b.y1, clip.y + clip.h - 1);
+        }
+        return b;
+    }
+
+    template<typename Derived>
+    bool Canvas<Derived>::setClipRect(const Rectangle* rect) {
+        clipEnabled = rect != nullptr;
+        if (rect) clip = *rect;
+        Bounds b = bounds();
+        return b.x0 <= b.x1 && b.y0 <= b.y1;
+    }
+
+    template<typename Derived>
+    Rectangle Canvas<Derived>::getClipRect() {
+        Bounds b = bounds();
+        return Rectangle(std::max(0, b.x1 - b.x0 + 1),
+                         std::max(0, b.y1 - b.y0 + 1), Position(b.x0, b.y0));
+    }
+
+    template<typename Derived>
+    template<bool Clip>
+    void Canvas<Derived>::plot(const Bounds& box, int x, int y) {
+        if (!Clip || box.contains(x, y)) {
+            if (blendMode == BlendMode::None) {
+                setPixel(x, y, drawColor);
+            } else {
+                paint(y, x, x);
+            }
+        }
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::setPixel(int x, int y, PixelValue v) {
+        static_cast<Derived*>(this)->setPixel(x, y, v);
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::fillSpan(int y, int x0, int x1, PixelValue v) {
+        static_cast<Derived*>(this)->fillSpan(y, x0, x1, v);
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::span(const Bounds& box, int y, int x0, int x1) {
+        if (x0 > x1) std::swap(x0, x1);
+        if (y < box.y0 || y > box.y1) return;
+        x0 = std::max(x0, box.x0);
+        x1 = std::min(x1, box.x1);
+        if (x0 <= x1) {
+            paint(y, x0, x1);
+        }
+    }
+
+    template<typename Derived>
+    bool Canvas<Derived>::clipLine(const Bounds& box, Position& a, Position& b,
+                                   int& err) {
+        if (a.x == b.x && a.y == b.y) return box.contains(a.x, a.y);
+
+        // p is the major axis, q the minor one; the pixel of step n is
+        // (p0 + sp * n, q0 + sq * m(n)) with m(n) = floor((2dn + D) / 2D)
+        bool xmajor = std::abs(b.x - a.x) >= std::abs(b.y - a.y);
+        long long p0 = xmajor ? a.x : a.y, q0 = xmajor ? a.y : a.x;
+        long long p1 = xmajor ? b.x : b.y, q1 = xmajor ? b.y : b.x;
+        long long D = std::abs(p1 - p0), d = std::abs(q1 - q0);
+        int sp = p0 < p1 ? 1 : -1, sq = q0 < q1 ? 1 : -1;
+        auto floordiv = [](long long n, long long k) {
+            return n / k - (n % k != 0 && (n < 0) != (k < 0));
+        };
+        auto ceildiv = [&floordiv](long long n, long long k) {
+            return -floordiv(-n, k);
+        };
+
+        // steps keeping p inside the box
+        long long plo = xmajor ? box.x0 : box.y0, phi = xmajor ? box.x1 : box.y1;
+        long long nlo = sp > 0 ? plo - p0 : p0 - phi;
+        long long nhi = sp > 0 ? phi - p0 : p0 - plo;
+        nlo = std::max(nlo, 0LL);
+        nhi = std::min(nhi, D);
+
+        // steps keeping q inside the box, m(n) is monotone
+        long long qlo = xmajor ? box.y0 : box.x0, qhi = xmajor ? box.y1 : box.x1;
+        long long mlo = sq > 0 ? qlo - q0 : q0 - qhi;
+        long long mhi = sq > 0 ? qhi - q0 : q0 - qlo;
+        if (d == 0) {
+            if (mlo > 0 || mhi < 0) return false;
+        } else {
+            nlo = std::max(nlo, ceildiv(2*D*mlo - D, 2*d));
+            nhi = std::min(nhi, ceildiv(2*D*(mhi+1) - D, 2*d) - 1);
+        }
+        if (nlo > nhi) return false;
+
+        long long mstart = floordiv(2*d*nlo + D, 2*D);
+        long long mend = floordiv(2*d*nhi + D, 2*D);
+        long long nx = xmajor ? nlo : mstart, ny = xmajor ? mstart : nlo;
+        long long dx = std::abs(b.x - a.x), dy = -std::abs(b.y - a.y);
+        // drawLine() adds dy per x step and dx per y step to err
+        err = (int)(dx*(1+ny) + dy*(1+nx));
+        if (xmajor) {
+            a = Position((int)(p0 + sp*nlo), (int)(q0 + sq*mstart));
+            b = Position((int)(p0 + sp*nhi), (int)(q0 + sq*mend));
+        } else {
+            a = Position((int)(q0 + sq*mstart), (int)(p0 + sp*nlo));
+            b = Position((int)(q0 + sq*mend), (int)(p0 + sp*nhi));
+        }
+        return true;
+    }
+
+    template<typename Derived>
+    int Canvas<Derived>::getHeight() {
+        return static_cast<Derived*>(this)->height();
+    }
+
+    template<typename Derived>
+    int Canvas<Derived>::getWidth() {
+        return static_cast<Derived*>(this)->width();
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::setDrawColor(Color c) {
+        drawColor = c.mapRGBA(getPixelFormat());
+        drawRGBA = c;
+        prepareBlend();
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::setDrawPixel(PixelValue v) {
+        drawColor = v;
+        SDL_GetRGBA(v, getPixelFormat(), &drawRGBA.red, &drawRGBA.green,
+                    &drawRGBA.blue, &drawRGBA.alpha);
+        prepareBlend();
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::setBlendMode(BlendMode::type m) {
+        blendMode = m;
+        prepareBlend();
+    }
+
+    template<typename Derived>
+    BlendMode::type Canvas<Derived>::getBlendMode() {
+        return blendMode;
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::prepareBlend() {
+        const Color& c = drawRGBA;
+        BlendColor& b = blendColor;
+        b.alpha = c.alpha;
+        switch (blendMode) {
+            case BlendMode::Mod:
+                b.red = c.red; b.green = c.green; b.blue = c.blue;
+                b.alpha = 0xff;
+                break;
+            default:
+                b.red = div255(c.red * c.alpha);
+                b.green = div255(c.green * c.alpha);
+                b.blue = div255(c.blue * c.alpha);
+                break;
+        }
+        b.pixel = SDL_MapRGBA(getPixelFormat(), b.red, b.green, b.blue,
+                blendMode == BlendMode::Add ? 0 : b.alpha);
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::paint(int y, int x0, int x1) {
+        Derived *d = static_cast<Derived*>(this);
+        switch (blendMode) {
+            case BlendMode::None:
+                d->fillSpan(y, x0, x1, drawColor);
+                break;
+            case BlendMode::Blend:
+                d->template blendSpan<BlendMode::Blend>(y, x0, x1, blendColor);
+                break;
+            case BlendMode::Add:
+                d->template blendSpan<BlendMode::Add>(y, x0, x1, blendColor);
+                break;
+            case BlendMode::Mod:
+                d->template blendSpan<BlendMode::Mod>(y, x0, x1, blendColor);
+                break;
+        }
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::blend(int y, int x0, int x1, const BlendColor& c) {
+        Derived *d = static_cast<Derived*>(this);
+        switch (blendMode) {
+            case BlendMode::Add:
+                d->template blendSpan<BlendMode::Add>(y, x0, x1, c);
+                break;
+            case BlendMode::Mod:
+                d->template blendSpan<BlendMode::Mod>(y, x0, x1, c);
+                break;
+            default:
+                d->template blendSpan<BlendMode::Blend>(y, x0, x1, c);
+                break;
+        }
+    }
+
+    template<typename Derived>
+    template<bool Clip>
+    void Canvas<Derived>::plotAA(const Bounds& box, int x, int y,
+                                 int intensity) {
+        if (intensity < 0) intensity = 0;
+        if (intensity >= 0xff || (Clip && !box.contains(x, y))) return;
+        blend(y, x, x, blendColor.scaled(0xff - intensity, blendMode));
+    }
+
+    template<typename Derived>
+    template<bool Clip>
+    void Canvas<Derived>::plotAA4(const Bounds& box, int xa, int xb,
+                                  int ya, int yb, int intensity) {
+        plotAA<Clip>(box, xa, ya, intensity);
+        if (xb != xa) plotAA<Clip>(box, xb, ya, intensity);
+        if (yb != ya) {
+            plotAA<Clip>(box, xa, yb, intensity);
+            if (xb != xa) plotAA<Clip>(box, xb, yb, intensity);
+        }
+    }
+
+    template<typename Derived>
+    SDL_PixelFormat *Canvas<Derived>::getPixelFormat() {
+        return static_cast<Derived*>(this)->getFormat();
+    }
+
+    template<typename Derived>
+    PixelValue Canvas<Derived>::getPixel(int x, int y) {
+        return static_cast<Derived*>(this)->getPixel(x, y);
+    }
+
+    inline Bpp4Surface::Bpp4Surface(int width, int height, PixelFormat format)
+        : Surface(width, height, Bpp4Surface::check(format)), Canvas() {}
+
+    inline void Bpp4Surface::trackDirty(DirtyRegion *region) {
+        Surface::trackDirty(region);
+        Canvas::trackDirty(region);
+    }
+
+    inline PixelFormat Bpp4Surface::check(PixelFormat format) {
+        PixelMask m(format);
+        if (m.bpp > 24) {
+            return format;
+        } else {
+            throw error::RuntimeError("format does not has 4 byte pixel");
+        }
+    }
+
+    inline std::uint32_t *Bpp4Surface::row(int y) {
+        auto rawbytes = static_cast<std::uint8_t*>(pixels());
+        return reinterpret_cast<std::uint32_t*>(rawbytes + y * pitch());
+    }
+
+    inline PixelRows<std::uint32_t> Bpp4Surface::rows() {
+        return Surface::rows<std::uint32_t>();
+    }
+
+    inline void Bpp4Surface::setPixel(int x, int y, PixelValue value) {
+        row(y)[x] = value;
+    }
+
+    inline PixelValue Bpp4Surface::getPixel(int x, int y) {
+        return row(y)[x];
+    }
+
+    inline void Bpp4Surface::fillSpan(int y, int x0, int x1, PixelValue value) {
+        SDLPP_COUNT(PixelsFilled, x1 - x0 + 1);
+        kernel::current->fill(row(y) + x0, x1 - x0 + 1, value);
+    }
+
+    template<BlendMode::type M>
+    void Bpp4Surface::blendSpan(int y, int x0, int x1, const BlendColor& c) {
+        SDLPP_COUNT(PixelsFilled, x1 - x0 + 1);
+        PixelBlend<M>::span(row(y) + x0, x1 - x0 + 1, c);
+    }
+
+    inline Bpp4View::Bpp4View(Bpp4Surface& s)
+        : Canvas(), bytes(static_cast<std::uint8_t*>(s.pixels())),
+          w(s.width()), h(s.height()), stride(s.pitch()), fmt(s.getFormat()) {}
+
+    inline Bpp4View::Bpp4View(void *pixels, int width, int height, int pitch,
+                              SDL_PixelFormat *format)
+        : Canvas(), bytes(static_cast<std::uint8_t*>(pixels)),
+          w(width), h(height), stride(pitch), fmt(format) {}
+
+    inline std::uint32_t *Bpp4View::row(int y) {
+        return reinterpret_cast<std::uint32_t*>(bytes + y * stride);
+    }
+
+    inline PixelRows<std::uint32_t> Bpp4View::rows() {
+        return PixelRows<std::uint32_t>(bytes, stride, w, h);
     }
 
-    inline int Surface::width() const {
-        return ptr->w;
+    inline void Bpp4View::setPixel(int x, int y, PixelValue value) {
+        row(y)[x] = value;
     }
 
-    inline int Surface::height() const {
-        return ptr->h;
+    inline PixelValue Bpp4View::getPixel(int x, int y) {
+        return row(y)[x];
     }
 
-    inline void Surface::setColorKey(const Color& c) {
-        if (SDL_SetColorKey(ptr, true,
-                    SDL_MapRGB(getFormat(), c.red, c.green, c.blue)) < 0) {
-            THROW_SDLPP_RUNTIME_ERROR();
-        }
+    inline void Bpp4View::fillSpan(int y, int x0, int x1, PixelValue value) {
+        SDLPP_COUNT(PixelsFilled, x1 - x0 + 1);
+        kernel::current->fill(row(y) + x0, x1 - x0 + 1, value);
     }
 
-    inline void Surface::unsetColorKey(const Color& c) {
-        if (SDL_SetColorKey(ptr, false,
-                    SDL_MapRGB(getFormat(), c.red, c.green, c.blue)) < 0) {
-            THROW_SDLPP_RUNTIME_ERROR();
-        }
+    template<BlendMode::type M>
+    void Bpp4View::blendSpan(int y, int x0, int x1, const BlendColor& c) {
+        SDLPP_COUNT(PixelsFilled, x1 - x0 + 1);
+        PixelBlend<M>::span(row(y) + x0, x1 - x0 + 1, c);
     }
 
+    inline SDL_PixelFormat *Bpp4View::getFormat() { return fmt; }
+    inline int Bpp4View::width() const { return w; }
+    inline int Bpp4View::height() const { return h; }
 
-    inline Color::Color(std::uint8_t r, std::uint8_t g,
-          std::uint8_t b, std::uint8_t a)
-        : red(r), green(g), blue(b), alpha(a) { }
+    template<typename Layout>
+    PixelSurface<Layout>::PixelSurface(int width, int height,
+                                       PixelFormat format)
+        : Surface(width, height, check(format)), Canvas<PixelSurface>() {}
 
-    inline void Texture::setColorMod(const Color& color) {
-        if (SDL_SetTextureColorMod(ptr, color.red, color.green, color.blue)
-               < 0) {
-            THROW_SDLPP_RUNTIME_ERROR();
-        }
+    template<typename Layout>
+    void PixelSurface<Layout>::trackDirty(DirtyRegion *region) {
+        Surface::trackDirty(region);
+        Canvas<PixelSurface>::trackDirty(region);
     }
 
-    inline void Window::restore() { SDL_RestoreWindow(ptr); }
-    inline Texture::Texture(SDL_Texture* t) : PointerHolder(t) {}
-
-    inline void Renderer::setTarget(TargetTexture* texture) {
-        if (SDL_SetRenderTarget(ptr, texture ? texture->get() : nullptr) <0) {
-            THROW_SDLPP_RUNTIME_ERROR();
+    template<typename Layout>
+    PixelFormat PixelSurface<Layout>::check(PixelFormat format) {
+        if (Layout::accepts(format)) {
+            return format;
+        } else {
+            throw error::RuntimeError("format does not match pixel layout");
         }
     }
 
-    inline StaticTexture Renderer::spawnStatic(int width, int height,
-                                                 PixelFormat format) {
-        return createTexture<StaticTexture>(format, SDL_TEXTUREACCESS_STATIC,
-                width, height);
+    template<typename Layout>
+    std::uint8_t *PixelSurface<Layout>::bytes(int y) {
+        return static_cast<std::uint8_t*>(pixels()) + y * pitch();
     }
 
-    inline StreamingTexture Renderer::spawnStreaming(
-            int width, int height, PixelFormat format) {
-        return createTexture<StreamingTexture>(format, SDL_TEXTUREACCESS_STREAMING,
-                width, height);
+    template<typename Layout>
+    typename Layout::type *PixelSurface<Layout>::row(int y) {
+        return reinterpret_cast<type*>(bytes(y));
     }
 
-    inline TargetTexture Renderer::spawnTarget(
-            int width, int height, PixelFormat format) {
-        return createTexture<TargetTexture>(format, SDL_TEXTUREACCESS_TARGET,
-                width, height);
+    template<typename Layout>
+    PixelRows<typename Layout::type> PixelSurface<Layout>::rows() {
+        return PixelRows<type>(pixels(), pitch(),
+                               width() * Layout::bytes / sizeof(type),
+                               height());
     }
 
-    template<typename T>
-    inline T Renderer::createTexture(PixelFormat format,
-            SDL_TextureAccess access, int width, int height) {
-        auto tp = SDL_CreateTexture(ptr, format, access, width, height);
-        if (!tp) { THROW_SDLPP_RUNTIME_ERROR(); }
-        return T(tp);
+    template<typename Layout>
+    void PixelSurface<Layout>::setPixel(int x, int y, PixelValue value) {
+        Layout::store(bytes(y) + x * Layout::bytes, value);
     }
 
-    inline void Texture::setAlphaMod(std::uint8_t alpha) {
-        if (SDL_SetTextureAlphaMod(ptr, alpha) < 0) {
-            THROW_SDLPP_RUNTIME_ERROR();
-        }
+    template<typename Layout>
+    PixelValue PixelSurface<Layout>::getPixel(int x, int y) {
+        return Layout::load(bytes(y) + x * Layout::bytes);
     }
 
-    inline void Texture::setBlendMode(BlendMode::type m) {
-        if (SDL_SetTextureBlendMode(ptr, (SDL_BlendMode)m) < 0) {
-            THROW_SDLPP_RUNTIME_ERROR();
-        }
+    template<typename Layout>
+    void PixelSurface<Layout>::fillSpan(int y, int x0, int x1,
+                                        PixelValue value) {
+        SDLPP_COUNT(PixelsFilled, x1 - x0 + 1);
+        Layout::fill(bytes(y) + x0 * Layout::bytes, x1 - x0 + 1, value);
     }
 
-    inline SDL_RendererFlip Renderer::horizontalFlip() {
-        return SDL_FLIP_HORIZONTAL;
+    template<typename Layout>
+    std::uint8_t PixelSurface<Layout>::decode(PixelValue v, std::uint32_t mask,
+                                              int shift, int loss) {
+        if (!mask) return 0xff;     // no alpha channel means opaque
+        // repeat the bits of the channel down to the low end of the byte
+        std::uint32_t c = ((v & mask) >> shift) << loss;
+        for (int bits = 8 - loss; bits < 8; bits *= 2) c |= c >> bits;
+        return (std::uint8_t)c;
     }
 
-    inline SDL_RendererFlip Renderer::verticalFlip() {
-        return SDL_FLIP_VERTICAL;
+    template<typename Layout>
+    PixelValue PixelSurface<Layout>::encode(std::uint8_t c, std::uint32_t mask,
+                                            int shift, int loss) {
+        return ((PixelValue)(c >> loss) << shift) & mask;
     }
 
-    inline void Renderer::copy(Texture& texture, const double angle,
-            const Rectangle* srcrect,
-            const Rectangle* destrect,
-            const Position* center,
-            SDL_RendererFlip flip) {
-        if (SDL_RenderCopyEx(ptr, texture.get(), srcrect, destrect, angle,
-                    center, flip) < 0) {
-           THROW_SDLPP_RUNTIME_ERROR();
+    template<typename Layout>
+    template<BlendMode::type M>
+    void PixelSurface<Layout>::blendSpan(int y, int x0, int x1,
+                                         const BlendColor& c) {
+        SDLPP_COUNT(PixelsFilled, x1 - x0 + 1);
+        typedef PixelBlend<M> B;
+        const SDL_PixelFormat *f = getFormat();
+        // alpha byte of BlendColor::pixel, see Canvas::prepareBlend()
+        const std::uint8_t srcAlpha = M == BlendMode::Add ? 0 : c.alpha;
+        std::uint8_t *p = bytes(y) + x0 * Layout::bytes;
+        for (int x = x0; x <= x1; x++, p += Layout::bytes) {
+            PixelValue v = Layout::load(p);
+            Color d(0, 0, 0);
+            if (Layout::indexed) {
+                SDL_GetRGBA(v, f, &d.red, &d.green, &d.blue, &d.alpha);
+            } else {
+                d.red = decode(v, f->Rmask, f->Rshift, f->Rloss);
+                d.green = decode(v, f->Gmask, f->Gshift, f->Gloss);
+                d.blue = decode(v, f->Bmask, f->Bshift, f->Bloss);
+                d.alpha = decode(v, f->Amask, f->Ashift, f->Aloss);
+            }
+            d.red = B::channel(d.red, c.red, c.alpha);
+            d.green = B::channel(d.green, c.green, c.alpha);
+            d.blue = B::channel(d.blue, c.blue, c.alpha);
+            d.alpha = B::channel(d.alpha, srcAlpha, c.alpha);
+            if (Layout::indexed) {
+                v = SDL_MapRGBA(f, d.red, d.green, d.blue, d.alpha);
+            } else {
+                v = encode(d.red, f->Rmask, f->Rshift, f->Rloss) |
+                    encode(d.green, f->Gmask, f->Gshift, f->Gloss) |
+                    encode(d.blue, f->Bmask, f->Bshift, f->Bloss) |
+                    encode(d.alpha, f->Amask, f->Ashift, f->Aloss);
+            }
+            Layout::store(p, v);
         }
     }
 
-    inline TargetTexture::TargetTexture(SDL_Texture*p) : Texture(p) {}
-    inline StaticTexture::StaticTexture(SDL_Texture*p) : Texture(p) {}
-    inline StreamingTexture::StreamingTexture(SDL_Texture*p) : Texture(p) {}
+    inline unsigned ThreadPool::size() const { return workers.size(); }
 
-    inline PixelMask::PixelMask(PixelFormat format) {
-        if (SDL_FALSE == SDL_PixelFormatEnumToMasks(format,
-                    &bpp, &rmask, &gmask, &bmask, &amask)) {
-            THROW_SDLPP_RUNTIME_ERROR();
-        }
-    }
+    inline std::size_t TiledCanvas::pending() const { return commands.size(); }
 
-    inline Surface::Surface(int width, int height, PixelFormat format)
-        : PointerHolder(nullptr), needDeallocate(true) {
-        PixelMask mask(format);
-        auto s = SDL_CreateRGBSurface(0, width, height, mask.bpp,
-                mask.rmask, mask.gmask, mask.bmask, mask.amask);
-        if (!s) { THROW_SDLPP_RUNTIME_ERROR(); }
-        ptr = s;
-    }
+    inline std::size_t RenderBatch::size() const { return items.size(); }
 
-    inline Surface::Surface(int width, int height, const PixelMask& mask)
-        : PointerHolder(nullptr), needDeallocate(true) {
-        auto s = SDL_CreateRGBSurface(0, width, height, mask.bpp,
-                mask.rmask, mask.gmask, mask.bmask, mask.amask);
-        if (!s) { THROW_SDLPP_RUNTIME_ERROR(); }
-        ptr = s;
-    }
+    inline Renderer& OffscreenTarget::renderer() { return render; }
+    inline Bpp4Surface& OffscreenTarget::canvas() { flush(); return surface; }
+    inline int OffscreenTarget::width() const { return surface.width(); }
+    inline int OffscreenTarget::height() const { return surface.height(); }
 
-    inline PixelFormat Surface::format() {
-        return (PixelFormat)getFormat()->format;
+    inline Texture& TextureAtlas::texture(AtlasRegion region) {
+        return book[entry(region).page]->texture;
     }
-
-    inline PixelValue Color::mapRGBA(SDL_PixelFormat *format) {
-        return SDL_MapRGBA(format, red, green, blue, alpha);
+    inline Rectangle TextureAtlas::rect(AtlasRegion region) const {
+        return entry(region).rect;
     }
+    inline std::size_t TextureAtlas::pages() const { return book.size(); }
 
-    inline PixelValue Color::mapRGB(SDL_PixelFormat *format) {
-        return SDL_MapRGB(format, red, green, blue);
-    }
+    inline std::size_t ImageLoader::pending() const { return loading; }
 
-    inline void * Surface::pixels() { return ptr->pixels; }
-    inline int Surface::Bpp() { return getFormat()->BytesPerPixel; }
-    inline int Surface::pitch() const { return ptr->pitch; }
+    inline void FrameLoop::stop() { running = false; }
+    inline const FrameLoop::Stats& FrameLoop::stats() const { return counters; }
 
-    template<typename Derived>
-    void Canvas<Derived>::drawPoint(Position pos) {
-        setPixel(pos.x, pos.y, drawColor);
-    }
+    inline Surface& CachedSurface::surface() { return image; }
+    inline const Surface& CachedSurface::surface() const { return image; }
+    inline bool CachedSurface::mapped() const { return file != nullptr; }
+    inline std::size_t SurfaceCache::hits() const { return hitCount; }
+    inline std::size_t SurfaceCache::misses() const { return missCount; }
 
-    template<typename Derived>
-    void Canvas<Derived>::setPixel(int x, int y, PixelValue v) {
-        static_cast<Derived*>(this)->setPixel(x, y, v);
-    }
+    template<typename T, typename Base>
+    PoolHandle<T, Base>::PoolHandle(ObjectPool<Base> *p, const PoolKey& k,
+                                    Owned o)
+        : pool(p), key(k), object(std::move(o)) {}
 
-    template<typename Derived>
-    int Canvas<Derived>::getHeight() {
-        return static_cast<Derived*>(this)->height();
-    }
+    template<typename T, typename Base>
+    PoolHandle<T, Base>::PoolHandle(PoolHandle&& h)
+        : pool(h.pool), key(h.key), object(std::move(h.object)) {}
 
-    template<typename Derived>
-    int Canvas<Derived>::getWidth() {
-        return static_cast<Derived*>(this)->width();
+    template<typename T, typename Base>
+    PoolHandle<T, Base>::~PoolHandle() {
+        if (object) {
+            pool->release(key, std::move(object));
+        }
     }
 
-    template<typename Derived>
-    void Canvas<Derived>::setDrawColor(Color c) {
-        drawColor = c.mapRGBA(getPixelFormat());
+    template<typename T, typename Base>
+    T& PoolHandle<T, Base>::operator*() const {
+        return static_cast<T&>(*object);
     }
 
-    template<typename Derived>
-    void Canvas<Derived>::setDrawPixel(PixelValue v) {
-        drawColor = v;
+    template<typename T, typename Base>
+    T* PoolHandle<T, Base>::operator->() const {
+        return static_cast<T*>(object.get());
     }
 
-    template<typename Derived>
-    SDL_PixelFormat *Canvas<Derived>::getPixelFormat() {
-        return static_cast<Derived*>(this)->getFormat();
-    }
+    template<typename T>
+    ObjectPool<T>::ObjectPool(std::size_t capacity)
+        : cap(capacity), idle(0), hitCount(0), missCount(0), clock(0) {}
 
-    template<typename Derived>
-    PixelValue Canvas<Derived>::getPixel(int x, int y) {
-        return static_cast<Derived*>(this)->getPixel(x, y);
+    template<typename T>
+    void ObjectPool<T>::setCapacity(std::size_t bytes) {
+        cap = bytes;
+        trim(cap);
     }
 
-    inline Bpp4Surface::Bpp4Surface(int width, int height, PixelFormat format)
-        : Surface(width, height, Bpp4Surface::check(format)), Canvas() {}
+    template<typename T>
+    std::size_t ObjectPool<T>::capacity() const { return cap; }
+    template<typename T>
+    std::size_t ObjectPool<T>::idleBytes() const { return idle; }
+    template<typename T>
+    std::size_t ObjectPool<T>::hits() const { return hitCount; }
+    template<typename T>
+    std::size_t ObjectPool<T>::misses() const { return missCount; }
+    template<typename T>
+    void ObjectPool<T>::clear() { trim(0); }
 
-    inline PixelFormat Bpp4Surface::check(PixelFormat format) {
-        PixelMask m(format);
-        if (m.bpp > 24) {
-            return format;
-        } else {
-            throw error::RuntimeError("format does not has 4 byte pixel");
+    template<typename T>
+    template<typename U>
+    void ObjectPool<T>::destroy(T *object) {
+        delete static_cast<U*>(object);
+    }
+
+    template<typename T>
+    template<typename U, typename Create>
+    PoolHandle<U, T> ObjectPool<T>::acquire(const PoolKey& k, Create create) {
+        // buckets stay when emptied, so steady use does not allocate
+        auto& bucket = buckets[k];
+        if (bucket.empty()) {
+            missCount++;
+            return PoolHandle<U, T>(this, k, Owned(create(), &destroy<U>));
         }
+        Owned object(std::move(bucket.back().object));
+        bucket.pop_back();
+        idle -= k.bytes();
+        hitCount++;
+        return PoolHandle<U, T>(this, k, std::move(object));
     }
 
-    inline void Bpp4Surface::setPixel(int x, int y, PixelValue value) {
-        auto rawbytes = static_cast<std::uint8_t*>(pixels());
-        rawbytes += y * pitch();
-        auto rawpixels = reinterpret_cast<std::uint32_t*>(rawbytes);
-        rawpixels += x;
-        *rawpixels = value;
+    template<typename T>
+    void ObjectPool<T>::release(const PoolKey& k, Owned object) {
+        Idle i = { std::move(object), clock++ };
+        buckets[k].push_back(std::move(i));
+        idle += k.bytes();
+        trim(cap);
     }
 
-    inline PixelValue Bpp4Surface::getPixel(int x, int y) {
-        auto rawbytes = static_cast<std::uint8_t*>(pixels());
-        rawbytes += y * pitch();
-        auto rawpixels = reinterpret_cast<std::uint32_t*>(rawbytes);
-        rawpixels += x;
-        return *rawpixels;
+    template<typename T>
+    void ObjectPool<T>::trim(std::size_t bytes) {
+        // the oldest of a bucket is its first, buckets are few
+        while (idle > bytes) {
+            auto oldest = buckets.end();
+            for (auto b = buckets.begin(); b != buckets.end(); ++b) {
+                if (!b->second.empty() && (oldest == buckets.end() ||
+                        b->second.front().stamp <
+                        oldest->second.front().stamp)) {
+                    oldest = b;
+                }
+            }
+            oldest->second.erase(oldest->second.begin());
+            idle -= oldest->first.bytes();
+        }
+    }
+
+    inline void Renderer::copy(TextureAtlas& atlas, AtlasRegion region,
+            const Rectangle* destrect) {
+        Rectangle src = atlas.rect(region);
+        copy(atlas.texture(region), &src, destrect);
     }
 
     inline Color::Color(PixelValue pixel, const SDL_PixelFormat* format) {
@@ -1109,6 +3688,7 @@ namespace sdlpp {
 
     template<typename Derived>
     PixelCell<Derived>& PixelCell<Derived>::operator=(Color c) {
+        canvas->touch(pos.x, pos.y, pos.x, pos.y);
         canvas->setPixel(pos.x, pos.y, c.mapRGBA(canvas->getPixelFormat()));
         return *this;
     }
@@ -1123,12 +3703,17 @@ namespace sdlpp {
 
     template<typename Derived>
     void Canvas<Derived>::drawLine(Position a, Position b) {
+        touch(std::min(a.x, b.x), std::min(a.y, b.y),
+              std::max(a.x, b.x), std::max(a.y, b.y));
         int dx = std::abs(b.x - a.x), sx = a.x < b.x ? 1 : -1;
         int dy = -std::abs(b.y - a.y), sy = a.y < b.y ? 1 : -1;
         int err = dx + dy, e2;
 
+        const Bounds box = bounds();
+        if (!clipLine(box, a, b, err)) return;
+
         for (; ;) {
-            drawPoint(a);
+            plot<false>(box, a.x, a.y);
             e2 = 2 * err;
             if (e2 >= dy) {
                 if (a.x == b.x) break;
@@ -1147,16 +3732,31 @@ namespace sdlpp {
 
     template<typename Derived>
     void Canvas<Derived>::drawEllipse(Position center, Position radius) {
+        const Bounds box = bounds();
+        int a = std::abs(radius.x), b = std::abs(radius.y);
+        touch(center.x - a, center.y - b, center.x + a, center.y + b);
+        switch (box.overlap(center.x - a, center.y - b,
+                            center.x + a, center.y + b)) {
+            case 1: rasterEllipse<true>(box, center, radius); break;
+            case 2: rasterEllipse<false>(box, center, radius); break;
+        }
+    }
+
+    template<typename Derived>
+    template<bool Clip>
+    void Canvas<Derived>::rasterEllipse(const Bounds& box, Position center,
+                                        Position radius) {
         int a = radius.x, b = radius.y;
         int xm = center.x, ym = center.y;
         int x = -a, y = 0;
         long e2 = (long)b*b, err = x*(2*e2+x)+e2;
 
+        // mirrored points on the axes are plotted once, for blending
         do {
-            setPixel(xm-x, ym+y, drawColor);
-            setPixel(xm+x, ym+y, drawColor);
-            setPixel(xm+x, ym-y, drawColor);
-            setPixel(xm-x, ym-y, drawColor);
+            plot<Clip>(box, xm-x, ym+y);
+            if (x) plot<Clip>(box, xm+x, ym+y);
+            if (y && x) plot<Clip>(box, xm+x, ym-y);
+            if (y) plot<Clip>(box, xm-x, ym-y);
             e2 = 2*err;
             if (e2 >= (x*2+1)*(long)b*b)
                 err += (++x*2+1) * (long)b*b;
@@ -1165,21 +3765,33 @@ namespace sdlpp {
         } while (x <= 0);
 
         while (y++ < b) {
-            setPixel(xm, ym+y, drawColor);
-            setPixel(xm, ym-y, drawColor);
+            plot<Clip>(box, xm, ym+y);
+            plot<Clip>(box, xm, ym-y);
         }
     }
 
     template<typename Derived>
     void Canvas<Derived>::fillEllipse(Position center, Position radius) {
+        const Bounds box = bounds();
         int a = radius.x, b = radius.y;
+        touch(center.x - std::abs(a), center.y - std::abs(b),
+              center.x + std::abs(a), center.y + std::abs(b));
+        if (!box.overlap(center.x - std::abs(a), center.y - std::abs(b),
+                         center.x + std::abs(a), center.y + std::abs(b))) {
+            return;
+        }
         int xm = center.x, ym = center.y;
         int x = -a, y = 0;
         long e2 = (long)b*b, err = x*(2*e2+x)+e2;
 
+        // x only grows, so the first x seen on a row is its widest span
+        int row = -1;
         do {
-            drawLine(Position(xm-x, ym+y), Position(xm+x, ym+y));
-            drawLine(Position(xm-x, ym-y), Position(xm+x, ym-y));
+            if (y != row) {
+                span(box, ym+y, xm-x, xm+x);
+                if (y) span(box, ym-y, xm-x, xm+x);
+                row = y;
+            }
             e2 = 2*err;
             if (e2 >= (x*2+1)*(long)b*b)
                 err += (++x*2+1) * (long)b*b;
@@ -1188,20 +3800,39 @@ namespace sdlpp {
         } while (x <= 0);
 
         while (y++ < b) {
-            drawLine(Position(xm, ym+y), Position(xm, ym-y));
+            span(box, ym+y, xm, xm);
+            span(box, ym-y, xm, xm);
         }
     }
 
     template<typename Derived>
     void Canvas<Derived>::drawCircle(Position center, int radius) {
+        const Bounds box = bounds();
+        int r = std::abs(radius);
+        touch(center.x - r, center.y - r, center.x + r, center.y + r);
+        switch (box.overlap(center.x - r, center.y - r,
+                            center.x + r, center.y + r)) {
+            case 1: rasterCircle<true>(box, center, radius); break;
+            case 2: rasterCircle<false>(box, center, radius); break;
+        }
+    }
+
+    template<typename Derived>
+    template<bool Clip>
+    void Canvas<Derived>::rasterCircle(const Bounds& box, Position center,
+                                       int radius) {
         int xm = center.x, ym = center.y, r = radius;
         int x = -r, y = 0, err = 2-2*r;
 
+        if (!r) {
+            plot<Clip>(box, xm, ym);
+            return;
+        }
         do {
-            setPixel(xm-x, ym+y, drawColor);
-            setPixel(xm-y, ym-x, drawColor);
-            setPixel(xm+x, ym-y, drawColor);
-            setPixel(xm+y, ym+x, drawColor);
+            plot<Clip>(box, xm-x, ym+y);
+            plot<Clip>(box, xm-y, ym-x);
+            plot<Clip>(box, xm+x, ym-y);
+            plot<Clip>(box, xm+y, ym+x);
             r = err;
             if (r <= y) err += ++y*2 + 1;
             if (r > x || err > y)
@@ -1211,6 +3842,22 @@ namespace sdlpp {
 
     template<typename Derived>
     void Canvas<Derived>::drawEllipse(Rectangle rect) {
+        const Bounds box = bounds();
+        // one pixel of margin for rounding at the ends of the axes
+        int xa = std::min(rect.x, rect.x + rect.w) - 1;
+        int ya = std::min(rect.y, rect.y + rect.h) - 1;
+        int xb = std::max(rect.x, rect.x + rect.w) + 1;
+        int yb = std::max(rect.y, rect.y + rect.h) + 1;
+        touch(xa, ya, xb, yb);
+        switch (box.overlap(xa, ya, xb, yb)) {
+            case 1: rasterEllipse<true>(box, rect); break;
+            case 2: rasterEllipse<false>(box, rect); break;
+        }
+    }
+
+    template<typename Derived>
+    template<bool Clip>
+    void Canvas<Derived>::rasterEllipse(const Bounds& box, Rectangle rect) {
         int x0 = rect.x, y0 = rect.y;
         int x1 = x0 + rect.w, y1 = y0 + rect.h;
 
@@ -1225,27 +3872,46 @@ namespace sdlpp {
         a = 8*a*a;
         b1 = 8*b*b;
 
+        // mirrored points on the axes are plotted once, for blending
+        int row;
         do {
-            setPixel(x1, y0, drawColor);
-            setPixel(x0, y0, drawColor);
-            setPixel(x0, y1, drawColor);
-            setPixel(x1, y1, drawColor);
+            plot<Clip>(box, x1, y0);
+            if (x0 != x1) plot<Clip>(box, x0, y0);
+            if (y0 != y1 && x0 != x1) plot<Clip>(box, x0, y1);
+            if (y0 != y1) plot<Clip>(box, x1, y1);
+            row = y0;
             e2 = 2*err;
             if (e2 <= dy) { y0++; y1-- ; err += dy += a; }
             if (e2 >= dx || 2*err > dy) { x0++; x1-- ; err += dx += b1;}
         } while (x0 <= x1);
 
+        // the last rows are already done if y did not move at the end
+        if (y0 == row) { y0++; y1--; }
         while (y0-y1 <= b) {
-            setPixel(x0-1, y0, drawColor);
-            setPixel(x1+1, y0++, drawColor);
-            setPixel(x0-1, y1, drawColor);
-            setPixel(x1+1, y1--, drawColor);
+            plot<Clip>(box, x0-1, y0);
+            if (x0-1 != x1+1) plot<Clip>(box, x1+1, y0);
+            if (y0 != y1) {
+                plot<Clip>(box, x0-1, y1);
+                if (x0-1 != x1+1) plot<Clip>(box, x1+1, y1);
+            }
+            y0++; y1--;
         }
     }
 
 
     template<typename Derived>
     void Canvas<Derived>::fillEllipse(Rectangle rect) {
+        const Bounds box = bounds();
+        touch(std::min(rect.x, rect.x + rect.w) - 1,
+              std::min(rect.y, rect.y + rect.h) - 1,
+              std::max(rect.x, rect.x + rect.w) + 1,
+              std::max(rect.y, rect.y + rect.h) + 1);
+        if (!box.overlap(std::min(rect.x, rect.x + rect.w) - 1,
+                         std::min(rect.y, rect.y + rect.h) - 1,
+                         std::max(rect.x, rect.x + rect.w) + 1,
+                         std::max(rect.y, rect.y + rect.h) + 1)) {
+            return;
+        }
         int x0 = rect.x, y0 = rect.y;
         int x1 = x0 + rect.w, y1 = y0 + rect.h;
 
@@ -1260,17 +3926,25 @@ namespace sdlpp {
         a = 8*a*a;
         b1 = 8*b*b;
 
+        // rows y0 (growing) and y1 (shrinking) are emitted when first
+        // reached, which is where [x0, x1] is the widest
+        int row = y0 - 1;
         do {
-            drawLine(Position(x1, y0), Position(x1, y1));
-            drawLine(Position(x0, y0), Position(x0, y1));
+            if (y0 != row) {
+                span(box, y0, x0, x1);
+                if (y1 != y0) span(box, y1, x0, x1);
+                row = y0;
+            }
             e2 = 2*err;
             if (e2 <= dy) { y0++; y1-- ; err += dy += a; }
             if (e2 >= dx || 2*err > dy) { x0++; x1-- ; err += dx += b1;}
         } while (x0 <= x1);
 
+        if (y0 == row) { y0++; y1--; }
         while (y0-y1 <= b) {
-            drawLine(Position(x0-1, y0), Position(x0-1, y1));
-            drawLine(Position(x1+1, y0++), Position(x1+1, y1--));
+            span(box, y0, x0-1, x1+1);
+            if (y1 != y0) span(box, y1, x0-1, x1+1);
+            y0++; y1--;
         }
     }
 
@@ -1283,41 +3957,295 @@ namespace sdlpp {
         Position b(rect.x+rect.w, rect.y);
         Position d(rect.x+rect.w, rect.y+rect.h);
         drawLine(a, b);
-        drawLine(a, c);
+        if (rect.h == 0) return;
         drawLine(c, d);
-        drawLine(b, d);
+        // sides without the corners, so no pixel is blended twice
+        int step = rect.h > 0 ? 1 : -1;
+        if (rect.h == step) return;
+        drawLine(Position(a.x, a.y+step), Position(c.x, c.y-step));
+        if (rect.w != 0) {
+            drawLine(Position(b.x, b.y+step), Position(d.x, d.y-step));
+        }
     }
 
     template<typename Derived>
     void Canvas<Derived>::fillRectangle(Rectangle rect) {
-        for (int i = rect.x; i < rect.x + rect.w; i++) {
-            for (int j = rect.y; j < rect.y + rect.h; j++) {
-                setPixel(i, j, drawColor);
-            }
+        const Bounds box = bounds();
+        int x0 = std::max(rect.x, box.x0);
+        int y0 = std::max(rect.y, box.y0);
+        int x1 = std::min(rect.x + rect.w - 1, box.x1);
+        int y1 = std::min(rect.y + rect.h - 1, box.y1);
+        if (x0 > x1) return;
+        touch(x0, y0, x1, y1);
+        for (int j = y0; j <= y1; j++) {
+            paint(j, x0, x1);
         }
     }
 
     template<typename Derived>
     void Canvas<Derived>::clear() {
-        const static Position start(0, 0);
-        fillRectangle(Rectangle(getWidth(), getHeight(), start));
+        const Bounds box = bounds();
+        touch(box.x0, box.y0, box.x1, box.y1);
+        for (int j = box.y0; j <= box.y1 && box.x0 <= box.x1; j++) {
+            fillSpan(j, box.x0, box.x1, drawColor);
+        }
     }
 
     template<typename Derived>
     void Canvas<Derived>::fillCircle(Position center, int radius) {
+        const Bounds box = bounds();
         int xm = center.x, ym = center.y, r = radius;
+        touch(xm - std::abs(r), ym - std::abs(r),
+              xm + std::abs(r), ym + std::abs(r));
+        if (!box.overlap(xm - std::abs(r), ym - std::abs(r),
+                         xm + std::abs(r), ym + std::abs(r))) {
+            return;
+        }
         int x = -r, y = 0, err = 2-2*r;
 
-        drawLine(Position(xm, ym-r), Position(xm, ym+r));
+        // x only grows, so the first x seen on a row is its widest span
+        int row = -1;
         do {
-            drawLine(Position(xm+x, ym+y), Position(xm+x, ym-y));
-            drawLine(Position(xm-x, ym+y), Position(xm-x, ym-y));
-
+            if (y != row) {
+                span(box, ym+y, xm+x, xm-x);
+                if (y) span(box, ym-y, xm+x, xm-x);
+                row = y;
+            }
             r = err;
             if (r <= y) err += ++y*2 + 1;
             if (r > x || err > y)
                 err += ++x * 2+1;
         } while (x < 0);
+
+        for (y = row + 1; y <= radius; y++) {
+            span(box, ym+y, xm, xm);
+            span(box, ym-y, xm, xm);
+        }
+    }
+
+    // the anti-aliased rasterizers below follow A. Zingl, "A Rasterizing
+    // Algorithm for Drawing Curves", intensity 0 means full coverage
+
+    template<typename Derived>
+    void Canvas<Derived>::drawLineAA(Position a, Position b) {
+        const Bounds box = bounds();
+        touch(std::min(a.x, b.x) - 1, std::min(a.y, b.y) - 1,
+              std::max(a.x, b.x) + 1, std::max(a.y, b.y) + 1);
+        switch (box.overlap(std::min(a.x, b.x) - 1, std::min(a.y, b.y) - 1,
+                            std::max(a.x, b.x) + 1, std::max(a.y, b.y) + 1)) {
+            case 1: rasterLineAA<true>(box, a, b); break;
+            case 2: rasterLineAA<false>(box, a, b); break;
+        }
+    }
+
+    template<typename Derived>
+    template<bool Clip>
+    void Canvas<Derived>::rasterLineAA(const Bounds& box, Position a,
+                                       Position b) {
+        int x0 = a.x, y0 = a.y, x1 = b.x, y1 = b.y;
+        int dx = std::abs(x1-x0), sx = x0 < x1 ? 1 : -1;
+        int dy = std::abs(y1-y0), sy = y0 < y1 ? 1 : -1;
+        int err = dx-dy, e2, x2;
+        int ed = dx+dy == 0 ? 1 : (int)std::sqrt((double)dx*dx + (double)dy*dy);
+
+        for (; ;) {
+            plotAA<Clip>(box, x0, y0, 255*std::abs(err-dx+dy)/ed);
+            e2 = err; x2 = x0;
+            if (2*e2 >= -dx) {
+                if (x0 == x1) break;
+                if (e2+dy < ed) plotAA<Clip>(box, x0, y0+sy, 255*(e2+dy)/ed);
+                err -= dy; x0 += sx;
+            }
+            if (2*e2 <= dy) {
+                if (y0 == y1) break;
+                if (dx-e2 < ed) plotAA<Clip>(box, x2+sx, y0, 255*(dx-e2)/ed);
+                err += dx; y0 += sy;
+            }
+        }
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::drawLineAA(Position a, Position b, double width) {
+        if (width <= 1) {
+            drawLineAA(a, b);
+            return;
+        }
+        const Bounds box = bounds();
+        int m = (int)std::ceil(width / 2) + 1;
+        touch(std::min(a.x, b.x) - m, std::min(a.y, b.y) - m,
+              std::max(a.x, b.x) + m, std::max(a.y, b.y) + m);
+        switch (box.overlap(std::min(a.x, b.x) - m, std::min(a.y, b.y) - m,
+                            std::max(a.x, b.x) + m, std::max(a.y, b.y) + m)) {
+            case 1: rasterLineAA<true>(box, a, b, width); break;
+            case 2: rasterLineAA<false>(box, a, b, width); break;
+        }
+    }
+
+    template<typename Derived>
+    template<bool Clip>
+    void Canvas<Derived>::rasterLineAA(const Bounds& box, Position a,
+                                       Position b, double wd) {
+        // walk the major axis and cover the pixels across the line by the
+        // distance of their centres to the segment a - b, so the line is
+        // wd pixels wide on both sides of it, with square ends half a
+        // pixel beyond a and b like the one pixel line
+        bool steep = std::abs(b.y - a.y) > std::abs(b.x - a.x);
+        double u0 = steep ? a.y : a.x, v0 = steep ? a.x : a.y;
+        double du = steep ? b.y - a.y : b.x - a.x;
+        double dv = steep ? b.x - a.x : b.y - a.y;
+        double len = std::sqrt(du*du + dv*dv);
+        double cu = len > 0 ? du/len : 1, cv = len > 0 ? dv/len : 0;
+        double h = wd/2 + 0.5;   // full coverage up to h - 1 off the line
+        double slope = du != 0 ? dv/du : 0;
+        double reach = h/std::abs(cu);
+        int ua = (int)std::min(u0, u0 + du) - (int)std::ceil(h) - 1;
+        int ub = (int)std::max(u0, u0 + du) + (int)std::ceil(h) + 1;
+
+        for (int u = ua; u <= ub; u++) {
+            double v = v0 + (u - u0)*slope;
+            int va = (int)std::floor(v - reach), vb = (int)std::ceil(v + reach);
+            for (int w = va; w <= vb; w++) {
+                double ru = u - u0, rv = w - v0;
+                double s = ru*cu + rv*cv;                 // along the line
+                double d = std::abs(rv*cu - ru*cv);       // across the line
+                double across = std::min(1.0, h - d);
+                double along = std::min(1.0, std::min(s, len - s) + 1);
+                if (across <= 0 || along <= 0) continue;
+                int i = 255 - (int)(255*across*along + 0.5);
+                if (steep) plotAA<Clip>(box, w, u, i);
+                else plotAA<Clip>(box, u, w, i);
+            }
+        }
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::drawCircleAA(Position center, int radius) {
+        const Bounds box = bounds();
+        int r = std::abs(radius) + 1;
+        touch(center.x - r, center.y - r, center.x + r, center.y + r);
+        switch (box.overlap(center.x - r, center.y - r,
+                            center.x + r, center.y + r)) {
+            case 1: rasterCircleAA<true>(box, center, std::abs(radius)); break;
+            case 2: rasterCircleAA<false>(box, center, std::abs(radius)); break;
+        }
+    }
+
+    template<typename Derived>
+    template<bool Clip>
+    void Canvas<Derived>::rasterCircleAA(const Bounds& box, Position center,
+                                         int r) {
+        // cover the pixels of the octant 0 <= x <= y by the distance of
+        // their centres to the circle and mirror them, so the circle has
+        // all eight symmetries and every pixel is blended once
+        int xm = center.x, ym = center.y;
+        if (!r) {
+            plotAA<Clip>(box, xm, ym, 0);
+            return;
+        }
+        double inner = (r-1.0)*(r-1.0), outer = (r+1.0)*(r+1.0);
+        for (int x = 0; 2.0*x*x <= outer; x++) {
+            int ya = (int)std::ceil(std::sqrt(std::max(0.0, inner - x*x)));
+            int yb = (int)std::sqrt(outer - x*x);
+            for (int y = std::max(x, ya); y <= yb; y++) {
+                double d = std::fabs(std::sqrt((double)x*x + (double)y*y) - r);
+                if (d >= 1) continue;
+                int i = (int)(255*d + 0.5);
+                plotAA4<Clip>(box, xm-x, xm+x, ym-y, ym+y, i);
+                if (x != y) plotAA4<Clip>(box, xm-y, xm+y, ym-x, ym+x, i);
+            }
+        }
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::drawEllipseAA(Position center, Position radius) {
+        int a = std::abs(radius.x), b = std::abs(radius.y);
+        drawEllipseAA(Rectangle(2*a, 2*b, Position(center.x-a, center.y-b)));
+    }
+
+    template<typename Derived>
+    void Canvas<Derived>::drawEllipseAA(Rectangle rect) {
+        const Bounds box = bounds();
+        int xa = std::min(rect.x, rect.x + rect.w) - 1;
+        int ya = std::min(rect.y, rect.y + rect.h) - 1;
+        int xb = std::max(rect.x, rect.x + rect.w) + 1;
+        int yb = std::max(rect.y, rect.y + rect.h) + 1;
+        touch(xa, ya, xb, yb);
+        switch (box.overlap(xa, ya, xb, yb)) {
+            case 1: rasterEllipseAA<true>(box, rect); break;
+            case 2: rasterEllipseAA<false>(box, rect); break;
+        }
+    }
+
+    template<typename Derived>
+    template<bool Clip>
+    void Canvas<Derived>::rasterEllipseAA(const Bounds& box, Rectangle rect) {
+        int x0 = rect.x, y0 = rect.y;
+        int x1 = x0 + rect.w, y1 = y0 + rect.h;
+        if (x0 == x1 || y0 == y1) {
+            rasterLineAA<Clip>(box, Position(x0, y0), Position(x1, y1));
+            return;
+        }
+
+        long a = std::abs(x1-x0), b = std::abs(y1-y0), b1 = b&1;
+        double dx = 4*(a-1.0)*b*b, dy = 4*(b1+1)*a*a;
+        double ed, i, err = b1*a*a-dx+dy;
+        bool f;
+        int row, below;     //!< rows of the last pixels at x0 and x1
+
+        if (x0 > x1) { x0 = x1; x1 += a; }
+        if (y0 > y1) y0 = y1;
+        y0 += (b+1)/2;
+        y1 = y0-b1;
+        a = 8*a*a;
+        b1 = 8*b*b;
+        row = below = y0-1;
+
+        for (; ;) {
+            i = std::min(dx, dy);
+            ed = std::max(dx, dy);
+            if (y0 == y1+1 && err > dy && a > b1) {
+                ed = 255*4./a;
+            } else {
+                ed = 255/(ed+2*ed*i*i/(4*ed*ed+i*i));
+            }
+            // the axis ends meet their mirror: x0 == x1 at the top and
+            // bottom, y0 == y1 at the sides of an even height. An odd
+            // width ends with x0 and x1 swapped, on pixels already done
+            // unless y moved to a new row
+            i = ed*std::fabs(err+dx-dy);
+            if (x0 <= x1 || (y0 != row && y0 != below)) {
+                plotAA4<Clip>(box, x0, x1, y0, y1, (int)i);
+            }
+            row = y0;
+            if ((f = 2*err+dy >= 0)) {
+                if (x0 >= x1) break;
+                i = ed*(err+dx);
+                if (i < 256) {
+                    plotAA4<Clip>(box, x0, x1, y0+1, y1-1, (int)i);
+                    if (i < 255) below = y0+1;  // else nothing was drawn
+                }
+            }
+            if (2*err <= dx) {
+                // next to each other, x0 + 1 and x1 - 1 are x1 and x0
+                i = ed*(dy-err);
+                if (i < 256 && x1-x0 > 1) {
+                    plotAA4<Clip>(box, x0+1, x1-1, y0, y1, (int)i);
+                }
+                y0++; y1--; err += dy += a;
+            }
+            if (f) { x0++; x1--; err -= dx -= b1; }
+        }
+
+        if (--x0 == x1++) {
+            while (y0-y1 < b) {
+                i = 255*4*std::fabs(err+dx)/b1;
+                y0++; y1--;
+                if (y0 != below) {
+                    plotAA4<Clip>(box, x0, x1, y0, y1, (int)i);
+                }
+                err += dy += a;
+            }
+        }
     }
 }
 
@@ -30,6 +30,9 @@
 #include "sdlpp.hpp"
 #define BOOST_TEST_MODULE SdlppTest
 #include <boost/test/unit_test.hpp>
+#include <climits>
+#include <cstdio>
+#include <sstream>
 
 BOOST_AUTO_TEST_CASE( sdlpp_initializer )
 {
@@ -37,3 +40,1389 @@ BOOST_AUTO_TEST_CASE( sdlpp_initializer )
     Initializer i1 = Initializer().video().audio();
     BOOST_CHECK_EQUAL(i1.value, SDL_INIT_AUDIO | SDL_INIT_VIDEO);
 }
+
+BOOST_AUTO_TEST_CASE( sdlpp_kernels )
+{
+    using namespace sdlpp;
+    const kernel::Table& ref = kernel::table(kernel::Isa::Scalar);
+    const kernel::Isa::type isas[] = { kernel::Isa::SSE2, kernel::Isa::AVX2 };
+
+    std::uint32_t src[67];
+    for (std::uint32_t i = 0; i < 67; i++) {
+        src[i] = i * 2654435761u;
+        if (i % 3 == 0) src[i] = (src[i] & 0xff000000) | 0x00ff00ff;
+    }
+
+    for (auto isa : isas) {
+        if (!kernel::supported(isa)) continue;
+        const kernel::Table& k = kernel::table(isa);
+        // odd offsets and lengths exercise unaligned heads and scalar tails
+        for (std::size_t off = 0; off < 3; off++) {
+            for (std::size_t n = 0; n < 64; n += 5) {
+                std::uint32_t expect[67], got[67];
+                std::copy(src, src + 67, expect);
+                std::copy(src, src + 67, got);
+
+                ref.colorKey(expect + off, n, 0x00ff00ff, 0xff000000);
+                k.colorKey(got + off, n, 0x00ff00ff, 0xff000000);
+                BOOST_CHECK(std::equal(expect, expect + 67, got));
+
+                ref.swapRB(expect + off, src, n);
+                k.swapRB(got + off, src, n);
+                BOOST_CHECK(std::equal(expect, expect + 67, got));
+
+                ref.fill(expect + off, n, 0xdeadbeef);
+                k.fill(got + off, n, 0xdeadbeef);
+                BOOST_CHECK(std::equal(expect, expect + 67, got));
+
+                // premultiplied colors, one opaque and one translucent
+                const std::uint32_t colors[] = { 0xff40c0ff, 0x80204060 };
+                for (std::uint32_t c : colors) {
+                    std::copy(src, src + 67, expect);
+                    std::copy(src, src + 67, got);
+                    ref.blend(expect + off, n, c, c >> 24);
+                    k.blend(got + off, n, c, c >> 24);
+                    BOOST_CHECK(std::equal(expect, expect + 67, got));
+                    ref.add(expect + off, n, c, c >> 24);
+                    k.add(got + off, n, c, c >> 24);
+                    BOOST_CHECK(std::equal(expect, expect + 67, got));
+                    ref.mod(expect + off, n, c, c >> 24);
+                    k.mod(got + off, n, c, c >> 24);
+                    BOOST_CHECK(std::equal(expect, expect + 67, got));
+                }
+            }
+        }
+    }
+    BOOST_CHECK(kernel::current == &kernel::best());
+}
+
+namespace {
+    // the pixels the per-line fills before the span rewrite set, drawn
+    // as vertical or horizontal lines from a to b into a 64x64 mask
+    struct LineMask {
+        std::vector<bool> set;
+        LineMask() : set(64 * 64) {}
+        void line(int x0, int y0, int x1, int y1) {
+            for (int y = std::min(y0, y1); y <= std::max(y0, y1); y++) {
+                for (int x = std::min(x0, x1); x <= std::max(x0, x1); x++) {
+                    set[y * 64 + x] = true;
+                }
+            }
+        }
+        void fillCircle(int xm, int ym, int r) {
+            int x = -r, y = 0, err = 2 - 2 * r;
+            line(xm, ym - r, xm, ym + r);
+            do {
+                line(xm + x, ym + y, xm + x, ym - y);
+                line(xm - x, ym + y, xm - x, ym - y);
+                r = err;
+                if (r <= y) err += ++y * 2 + 1;
+                if (r > x || err > y) err += ++x * 2 + 1;
+            } while (x < 0);
+        }
+        void fillEllipse(int xm, int ym, int a, int b) {
+            int x = -a, y = 0;
+            long e2 = (long)b * b, err = x * (2 * e2 + x) + e2;
+            do {
+                line(xm - x, ym + y, xm + x, ym + y);
+                line(xm - x, ym - y, xm + x, ym - y);
+                e2 = 2 * err;
+                if (e2 >= (x * 2 + 1) * (long)b * b)
+                    err += (++x * 2 + 1) * (long)b * b;
+                if (e2 <= (y * 2 + 1) * (long)a * a)
+                    err += (++y * 2 + 1) * (long)a * a;
+            } while (x <= 0);
+            while (y++ < b) {
+                line(xm, ym + y, xm, ym - y);
+            }
+        }
+        void fillEllipseRect(int x0, int y0, int w, int h) {
+            int x1 = x0 + w, y1 = y0 + h;
+            long a = std::abs(x1 - x0), b = std::abs(y1 - y0), b1 = b & 1;
+            double dx = 4 * (1.0 - a) * b * b, dy = 4 * (b1 + 1) * a * a;
+            double err = dx + dy + b1 * a * a, e2;
+            y0 += (b + 1) / 2;
+            y1 = y0 - b1;
+            a = 8 * a * a;
+            b1 = 8 * b * b;
+            do {
+                line(x1, y0, x1, y1);
+                line(x0, y0, x0, y1);
+                e2 = 2 * err;
+                if (e2 <= dy) { y0++; y1--; err += dy += a; }
+                if (e2 >= dx || 2 * err > dy) { x0++; x1--; err += dx += b1; }
+            } while (x0 <= x1);
+            while (y0 - y1 <= b) {
+                line(x0 - 1, y0, x0 - 1, y1);
+                line(x1 + 1, y0++, x1 + 1, y1--);
+            }
+        }
+    };
+
+    // pixels where canvas and mask disagree, the canvas was cleared to 0
+    int maskDifference(sdlpp::Bpp4Surface& canvas, const LineMask& mask)
+    {
+        int wrong = 0;
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++) {
+                wrong += (canvas.getPixel(x, y) != 0) != mask.set[y * 64 + x];
+            }
+        }
+        return wrong;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_filled_spans )
+{
+    using namespace sdlpp;
+    Bpp4Surface canvas(64, 64, SDL_PIXELFORMAT_ARGB8888);
+    auto draw = [&](std::function<void()> fill, const LineMask& mask) {
+        canvas.setDrawColor(Color(0, 0, 0, 0));
+        canvas.clear();
+        canvas.setDrawColor(Color::White);
+        fill();
+        return maskDifference(canvas, mask);
+    };
+    // odd and even radii and sizes
+    for (int r = 1; r <= 20; r++) {
+        LineMask circle;
+        circle.fillCircle(31, 30, r);
+        BOOST_CHECK_EQUAL(draw([&]() {
+            canvas.fillCircle(Position(31, 30), r);
+        }, circle), 0);
+        for (int b = 1; b <= 20; b += 3) {
+            LineMask ellipse;
+            ellipse.fillEllipse(31, 30, r, b);
+            BOOST_CHECK_EQUAL(draw([&]() {
+                canvas.fillEllipse(Position(31, 30), Position(r, b));
+            }, ellipse), 0);
+            LineMask rect;
+            rect.fillEllipseRect(10, 12, r + 10, b + 10);
+            BOOST_CHECK_EQUAL(draw([&]() {
+                canvas.fillEllipse(Rectangle(r + 10, b + 10, Position(10, 12)));
+            }, rect), 0);
+        }
+    }
+}
+
+namespace {
+    // draw on a whole canvas and through clip, clipping must only drop
+    // the pixels outside clip; returns the number of other differences
+    template<typename Draw>
+    int clipDifference(sdlpp::Rectangle clip, Draw draw)
+    {
+        using namespace sdlpp;
+        Bpp4Surface whole(80, 60, SDL_PIXELFORMAT_ARGB8888);
+        Bpp4Surface clipped(80, 60, SDL_PIXELFORMAT_ARGB8888);
+        Bpp4Surface* both[] = { &whole, &clipped };
+        for (Bpp4Surface* s : both) {
+            s->setDrawColor(Color::Black);
+            s->clear();
+            s->setDrawColor(Color(200, 100, 50));
+        }
+        const std::uint32_t black = clipped.getPixel(0, 0);
+        clipped.setClipRect(&clip);
+        draw(whole);
+        draw(clipped);
+
+        int wrong = 0;
+        for (int y = 0; y < 60; y++) {
+            for (int x = 0; x < 80; x++) {
+                bool inside = x >= clip.x && x < clip.x + clip.w &&
+                              y >= clip.y && y < clip.y + clip.h;
+                wrong += clipped.getPixel(x, y) !=
+                         (inside ? whole.getPixel(x, y) : black);
+            }
+        }
+        return wrong;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_clipped_shapes )
+{
+    using namespace sdlpp;
+    const Rectangle clips[] = {
+        Rectangle(30, 20, Position(25, 20)),
+        Rectangle(80, 60, Position(0, 0)),
+        Rectangle(1, 60, Position(40, 0)),
+        Rectangle(13, 7, Position(0, 53)),
+    };
+    for (const Rectangle& clip : clips) {
+        BOOST_CHECK_EQUAL(clipDifference(clip, [](Bpp4Surface& c) {
+            c.drawLine(Position(-30, -17), Position(120, 71));
+            c.drawLine(Position(5, 58), Position(77, 3));
+            c.drawLine(Position(40, -100), Position(41, 300));
+            c.drawLine(Position(-10, 33), Position(90, 33));
+        }), 0);
+        BOOST_CHECK_EQUAL(clipDifference(clip, [](Bpp4Surface& c) {
+            c.drawCircle(Position(40, 30), 27);
+            c.drawCircle(Position(3, 57), 19);
+            c.fillCircle(Position(70, 10), 15);
+        }), 0);
+        BOOST_CHECK_EQUAL(clipDifference(clip, [](Bpp4Surface& c) {
+            c.drawEllipse(Position(40, 30), Position(45, 12));
+            c.fillEllipse(Rectangle(31, 50, Position(-9, 20)));
+            c.drawEllipse(Rectangle(90, 25, Position(-5, 40)));
+        }), 0);
+    }
+}
+
+namespace {
+    // one pixel of (100, 150, 200) drawn over by (255, 0, 128, 64) in mode
+    template<typename S>
+    sdlpp::Color blendOne(S& s, sdlpp::BlendMode::type mode)
+    {
+        using namespace sdlpp;
+        s.setBlendMode(BlendMode::None);
+        s.setDrawColor(Color(100, 150, 200));
+        s.drawPoint(Position(1, 1));
+        s.setBlendMode(mode);
+        s.setDrawColor(Color(255, 0, 128, 64));
+        s.drawPoint(Position(1, 1));
+        Color c(0, 0, 0);
+        SDL_GetRGBA(s.getPixel(1, 1), s.getFormat(), &c.red, &c.green,
+                    &c.blue, &c.alpha);
+        return c;
+    }
+
+    bool sameColor(sdlpp::Color a, sdlpp::Color b)
+    {
+        return a.red == b.red && a.green == b.green && a.blue == b.blue &&
+               a.alpha == b.alpha;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_blend_modes )
+{
+    using namespace sdlpp;
+    int wrong = 0;
+    for (std::uint32_t v = 0; v <= 255 * 255; v++) {
+        wrong += div255(v) != (v + 127) / 255;
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+
+    // the four channel kernels are the one channel formulas bytewise
+    std::uint32_t seed = 12345;
+    auto next = [&seed]() { return seed = seed * 1664525u + 1013904223u; };
+    for (int n = 0; n < 10000; n++) {
+        std::uint32_t dst = next(), src = next();
+        std::uint8_t alpha = src >> 24;
+        // premultiplied, no channel of src exceeds its alpha
+        std::uint32_t pre = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            pre |= div255(((src >> shift) & 0xff) * alpha) << shift;
+        }
+        pre = (pre & 0x00ffffff) | (std::uint32_t)alpha << 24;
+        PixelValue blend = PixelBlend<BlendMode::Blend>::apply(dst, pre, alpha);
+        PixelValue add = PixelBlend<BlendMode::Add>::apply(dst, src, 0);
+        PixelValue mod = PixelBlend<BlendMode::Mod>::apply(dst, src, 0);
+        for (int shift = 0; shift < 32; shift += 8) {
+            std::uint32_t d = (dst >> shift) & 0xff;
+            std::uint32_t p = (pre >> shift) & 0xff, q = (src >> shift) & 0xff;
+            wrong += ((blend >> shift) & 0xff) !=
+                     PixelBlend<BlendMode::Blend>::channel(d, p, alpha);
+            wrong += ((add >> shift) & 0xff) !=
+                     PixelBlend<BlendMode::Add>::channel(d, q, 0);
+            wrong += ((mod >> shift) & 0xff) !=
+                     PixelBlend<BlendMode::Mod>::channel(d, q, 0);
+        }
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+
+    // Blend: 255 * 64 / 255 + 100 * 191 / 255 = 64 + 75 and so on, Add
+    // adds the premultiplied color, Mod multiplies by the plain one
+    Bpp4Surface argb(4, 4, SDL_PIXELFORMAT_ARGB8888);
+    Bpp3Surface rgb(4, 4, SDL_PIXELFORMAT_RGB24);
+    BOOST_CHECK(sameColor(blendOne(argb, BlendMode::None),
+                          Color(255, 0, 128, 64)));
+    BOOST_CHECK(sameColor(blendOne(argb, BlendMode::Blend),
+                          Color(139, 112, 182, 255)));
+    BOOST_CHECK(sameColor(blendOne(argb, BlendMode::Add),
+                          Color(164, 150, 232, 255)));
+    BOOST_CHECK(sameColor(blendOne(argb, BlendMode::Mod),
+                          Color(100, 0, 100, 255)));
+    BOOST_CHECK(sameColor(blendOne(rgb, BlendMode::Blend),
+                          Color(139, 112, 182, 255)));
+    BOOST_CHECK(sameColor(blendOne(rgb, BlendMode::Add),
+                          Color(164, 150, 232, 255)));
+    BOOST_CHECK(sameColor(blendOne(rgb, BlendMode::Mod),
+                          Color(100, 0, 100, 255)));
+
+    // an opaque color replaces the pixel in Blend, like None
+    argb.setBlendMode(BlendMode::Blend);
+    argb.setDrawColor(Color(1, 2, 3));
+    argb.drawPoint(Position(2, 2));
+    BOOST_CHECK_EQUAL(argb.getPixel(2, 2), 0xff010203u);
+}
+
+namespace {
+    // gray outlines on black, the blue channel tells the coverage
+    int blue(sdlpp::Bpp4Surface& s, int x, int y)
+    {
+        return s.getPixel(x, y) & 0xff;
+    }
+
+    template<typename Draw>
+    void drawGray(sdlpp::Bpp4Surface& s, std::uint8_t alpha, Draw draw)
+    {
+        using namespace sdlpp;
+        s.setBlendMode(BlendMode::None);
+        s.setDrawColor(Color::Black);
+        s.clear();
+        s.setBlendMode(BlendMode::Blend);
+        s.setDrawColor(Color(255, 255, 255, alpha));
+        draw(s);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_translucent_ellipse_aa )
+{
+    using namespace sdlpp;
+    // odd and even axes, the ends of which meet their mirror images
+    const Rectangle rects[] = {
+        Rectangle(40, 20, Position(5, 5)), Rectangle(29, 20, Position(5, 5)),
+        Rectangle(30, 21, Position(6, 4)), Rectangle(21, 45, Position(8, 3)),
+        Rectangle(1, 30, Position(20, 5)), Rectangle(44, 2, Position(2, 20))
+    };
+    for (auto& rect : rects) {
+        Bpp4Surface opaque(56, 56, SDL_PIXELFORMAT_ARGB8888);
+        Bpp4Surface half(56, 56, SDL_PIXELFORMAT_ARGB8888);
+        auto draw = [&rect](Bpp4Surface& s) { s.drawEllipseAA(rect); };
+        drawGray(opaque, 255, draw);
+        drawGray(half, 128, draw);
+        // blended once, each pixel is the opaque coverage at half alpha
+        int wrong = 0;
+        for (int y = 0; y < 56; y++) {
+            for (int x = 0; x < 56; x++) {
+                std::uint32_t o = blue(opaque, x, y);
+                wrong += blue(half, x, y) != (int)div255(128 * o);
+            }
+        }
+        BOOST_CHECK_EQUAL(wrong, 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_wide_line_aa )
+{
+    using namespace sdlpp;
+    Bpp4Surface s(64, 64, SDL_PIXELFORMAT_ARGB8888);
+    drawGray(s, 255, [](Bpp4Surface& c) {
+        c.drawLineAA(Position(10, 20), Position(50, 20), 6);
+    });
+    // 6 pixels around row 20: rows 18 .. 22 and half of 17 and 23
+    for (int x = 10; x <= 50; x++) {
+        for (int d = 0; d <= 2; d++) {
+            BOOST_CHECK_EQUAL(blue(s, x, 20 - d), 255);
+            BOOST_CHECK_EQUAL(blue(s, x, 20 + d), 255);
+        }
+        BOOST_CHECK_EQUAL(blue(s, x, 17), blue(s, x, 23));
+        BOOST_CHECK(std::abs(blue(s, x, 17) - 128) <= 1);
+        BOOST_CHECK_EQUAL(blue(s, x, 16), 0);
+        BOOST_CHECK_EQUAL(blue(s, x, 24), 0);
+    }
+    BOOST_CHECK_EQUAL(blue(s, 9, 20), 0);
+    BOOST_CHECK_EQUAL(blue(s, 51, 20), 0);
+
+    // a diagonal is mirrored by the line itself, a row crosses it over
+    // width * sqrt(2) pixels
+    drawGray(s, 255, [](Bpp4Surface& c) {
+        c.drawLineAA(Position(8, 8), Position(50, 50), 5);
+    });
+    int wrong = 0;
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            wrong += blue(s, x, y) != blue(s, y, x);
+        }
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+    int sum = 0;
+    for (int x = 0; x < 64; x++) {
+        sum += blue(s, x, 29);
+    }
+    BOOST_CHECK(std::abs(sum - 5 * std::sqrt(2.0) * 255) < 0.1 * 255);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_aa_coverage )
+{
+    using namespace sdlpp;
+    Bpp4Surface s(64, 64, SDL_PIXELFORMAT_ARGB8888);
+    Bpp4Surface r(64, 64, SDL_PIXELFORMAT_ARGB8888);
+
+    // a one pixel line covers 1 / cos(angle) pixels per column in
+    // total, whichever end it starts from
+    drawGray(s, 255, [](Bpp4Surface& c) {
+        c.drawLineAA(Position(3, 5), Position(60, 30));
+    });
+    drawGray(r, 255, [](Bpp4Surface& c) {
+        c.drawLineAA(Position(60, 30), Position(3, 5));
+    });
+    int wrong = 0;
+    for (int x = 3; x <= 60; x++) {
+        int sum = 0;
+        for (int y = 0; y < 64; y++) {
+            sum += blue(s, x, y);
+            wrong += blue(s, x, y) != blue(r, x, y);
+        }
+        wrong += std::abs(sum - 255 * std::sqrt(57.0 * 57 + 25 * 25) / 57) >
+                 0.1 * 255;
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+
+    // axis aligned lines are fully covered and nothing else
+    drawGray(s, 255, [](Bpp4Surface& c) {
+        c.drawLineAA(Position(2, 10), Position(40, 10));
+        c.drawLineAA(Position(50, 2), Position(50, 60));
+    });
+    wrong = 0;
+    int covered = 0;
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            int b = blue(s, x, y);
+            wrong += b != 0 && b != 255;
+            covered += b == 255;
+        }
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+    BOOST_CHECK_EQUAL(covered, 39 + 59);
+
+    // circles have all eight symmetries, ellipses the four of their axes
+    drawGray(s, 255, [](Bpp4Surface& c) {
+        c.drawCircleAA(Position(31, 31), 23);
+    });
+    drawGray(r, 255, [](Bpp4Surface& c) {
+        c.drawEllipseAA(Position(31, 31), Position(27, 12));
+    });
+    wrong = 0;
+    int total = 0;
+    for (int y = 0; y < 63; y++) {
+        for (int x = 0; x < 63; x++) {
+            total += blue(s, x, y);
+            wrong += blue(s, x, y) != blue(s, 62 - x, y);
+            wrong += blue(s, x, y) != blue(s, x, 62 - y);
+            wrong += blue(s, x, y) != blue(s, y, x);
+            wrong += blue(r, x, y) != blue(r, 62 - x, y);
+            wrong += blue(r, x, y) != blue(r, x, 62 - y);
+        }
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+    // about the circumference in pixels
+    BOOST_CHECK(std::abs(total - 2 * 3.14159 * 23 * 255) < 0.05 * total);
+}
+
+namespace {
+    // the same scene drawn on a Bpp4Surface and on a TiledCanvas
+    template<typename C>
+    void tiledScene(C& c)
+    {
+        using namespace sdlpp;
+        c.setDrawColor(Color::White);
+        c.clear();
+        c.setDrawColor(Color::Purple);
+        c.fillCircle(Position(60, 50), 45);
+        c.fillEllipse(Rectangle(150, 80, Position(100, 90)));
+        c.setBlendMode(BlendMode::Blend);
+        c.setDrawColor(Color(0, 0, 255, 100));
+        c.fillRectangle(Rectangle(120, 120, Position(-20, 70)));
+        c.drawLineAA(Position(5, 190), Position(290, 3), 5);
+        c.drawCircleAA(Position(220, 60), 50);
+        c.setBlendMode(BlendMode::Add);
+        Rectangle clip(100, 100, Position(90, 40));
+        c.setClipRect(&clip);
+        c.setDrawColor(Color(40, 80, 20));
+        c.drawEllipse(Position(150, 100), Position(80, 40));
+        c.drawEllipseAA(Position(150, 90), Position(70, 20));
+        c.setClipRect();
+        c.setBlendMode(BlendMode::None);
+        c.setDrawColor(Color::Red);
+        c.drawLine(Position(-50, -30), Position(320, 230));
+        c.drawRectangle(Rectangle(280, 180, Position(10, 10)));
+        c.drawCircle(Position(150, 100), 99);
+        c.drawPoint(Position(299, 199));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_tiled_canvas )
+{
+    using namespace sdlpp;
+    Bpp4Surface direct(300, 200, SDL_PIXELFORMAT_ARGB8888);
+    Bpp4Surface tiled(300, 200, SDL_PIXELFORMAT_ARGB8888);
+    tiledScene(direct);
+
+    ThreadPool pool(3);
+    TiledCanvas canvas(tiled, pool, 40, 24);
+    tiledScene(canvas);
+    BOOST_CHECK(canvas.pending() > 0);
+    canvas.flush();
+    BOOST_CHECK_EQUAL(canvas.pending(), 0u);
+
+    for (int y = 0; y < 200; y++) {
+        auto a = static_cast<std::uint8_t*>(direct.pixels()) + y * direct.pitch();
+        auto b = static_cast<std::uint8_t*>(tiled.pixels()) + y * tiled.pitch();
+        BOOST_CHECK(std::equal(a, a + 300 * 4, b));
+    }
+
+    // flushed from a task of its own pool, even with a single worker
+    ThreadPool single(1);
+    Bpp4Surface nested(300, 200, SDL_PIXELFORMAT_ARGB8888);
+    TiledCanvas inner(nested, single, 40, 24);
+    tiledScene(inner);
+    BOOST_CHECK(!single.isWorker());
+    single.post([&]() { inner.flush(); });
+    single.wait();
+    BOOST_CHECK_EQUAL(inner.pending(), 0u);
+    for (int y = 0; y < 200; y++) {
+        auto a = static_cast<std::uint8_t*>(direct.pixels()) + y * direct.pitch();
+        auto b = static_cast<std::uint8_t*>(nested.pixels()) + y * nested.pitch();
+        BOOST_CHECK(std::equal(a, a + 300 * 4, b));
+    }
+}
+
+namespace {
+    // the same pixel in another format
+    sdlpp::PixelValue remap(sdlpp::PixelValue v, SDL_PixelFormat *from,
+                            SDL_PixelFormat *to)
+    {
+        std::uint8_t r, g, b, a;
+        SDL_GetRGBA(v, from, &r, &g, &b, &a);
+        return SDL_MapRGBA(to, r, g, b, a);
+    }
+
+    // drawing on S must give the 32 bit result mapped to S's format;
+    // every blend rounds to the channels of the format, so pixels blended
+    // over each other may be off by that many steps of a channel
+    template<typename S>
+    void checkLayout(S& s, int steps)
+    {
+        using namespace sdlpp;
+        Bpp4Surface ref(s.width(), s.height(), SDL_PIXELFORMAT_ARGB8888);
+        tiledScene(ref);
+        tiledScene(s);
+        SDL_PixelFormat *f = s.getFormat();
+        // a palette is the 3-3-2 one of sdlpp_pixel_layouts
+        const int loss[] = { f->palette ? 5 : f->Rloss,
+                             f->palette ? 5 : f->Gloss,
+                             f->palette ? 6 : f->Bloss };
+        int wrong = 0;
+        for (int y = 0; y < s.height(); y++) {
+            for (int x = 0; x < s.width(); x++) {
+                Color a(0, 0, 0), b(0, 0, 0);
+                PixelValue want = remap(ref.getPixel(x, y), ref.getFormat(), f);
+                SDL_GetRGBA(want, f, &a.red, &a.green, &a.blue, &a.alpha);
+                SDL_GetRGBA(s.getPixel(x, y), f, &b.red, &b.green, &b.blue,
+                            &b.alpha);
+                const int diff[] = { a.red - b.red, a.green - b.green,
+                                     a.blue - b.blue };
+                for (int i = 0; i < 3; i++) {
+                    wrong += std::abs(diff[i]) > steps << loss[i];
+                }
+            }
+        }
+        BOOST_CHECK_EQUAL(wrong, 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_pixel_layouts )
+{
+    using namespace sdlpp;
+    Bpp3Surface rgb24(300, 200, SDL_PIXELFORMAT_RGB24);
+    checkLayout(rgb24, 0);
+    Bpp2Surface rgb565(300, 200, SDL_PIXELFORMAT_RGB565);
+    checkLayout(rgb565, 2);
+    Bpp1Surface index8(300, 200, SDL_PIXELFORMAT_INDEX8);
+    std::vector<Color> rgb332;
+    for (int i = 0; i < 256; i++) {
+        rgb332.push_back(Color(i & 0xe0, (i << 3) & 0xe0, (i << 6) & 0xc0));
+    }
+    index8.setPalette(rgb332.data(), 256);
+    checkLayout(index8, 1);
+
+    BOOST_CHECK_THROW(Bpp2Surface(4, 4, SDL_PIXELFORMAT_RGB24),
+                      error::RuntimeError);
+    BOOST_CHECK_THROW(Bpp1Surface(4, 4, SDL_PIXELFORMAT_RGB565),
+                      error::RuntimeError);
+
+    const Color gray[] = { Color(10, 10, 10), Color(20, 20, 20) };
+    index8.setPalette(gray, 2, 254);
+    index8.setDrawColor(Color(20, 20, 20));
+    index8.drawPoint(Position(0, 0));
+    BOOST_CHECK_EQUAL(index8.getPixel(0, 0), 255u);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_dirty_region )
+{
+    using namespace sdlpp;
+    DirtyRegion region(2);
+    BOOST_CHECK(region.empty());
+    region.add(Rectangle(10, 10, Position(0, 0)));
+    region.add(Rectangle(5, 5, Position(2, 2)));   // inside the first one
+    region.add(Rectangle(10, 10, Position(10, 0))); // adjacent, merged
+    BOOST_REQUIRE_EQUAL(region.rects().size(), 1u);
+    BOOST_CHECK_EQUAL(region.rects()[0].w, 20);
+
+    region.add(Rectangle(1, 1, Position(100, 100)));
+    region.add(Rectangle(1, 1, Position(100, 200)));
+    BOOST_CHECK_EQUAL(region.rects().size(), 2u); // capacity is kept
+    Rectangle b = region.bounds();
+    BOOST_CHECK(b.x == 0 && b.y == 0 && b.w == 101 && b.h == 201);
+
+    Bpp4Surface canvas(64, 64, SDL_PIXELFORMAT_ARGB8888);
+    Bpp4Surface sprite(8, 8, SDL_PIXELFORMAT_ARGB8888);
+    region.clear();
+    canvas.trackDirty(&region);
+    canvas.fillRectangle(Rectangle(10, 10, Position(-5, -5)));
+    Position at(60, 60);
+    canvas.blit(sprite, nullptr, &at);
+    BOOST_REQUIRE_EQUAL(region.rects().size(), 2u);
+    b = region.rects()[0];
+    BOOST_CHECK(b.x == 0 && b.y == 0 && b.w == 5 && b.h == 5);
+    b = region.rects()[1];
+    BOOST_CHECK(b.x == 60 && b.y == 60 && b.w == 4 && b.h == 4);
+
+    canvas.trackDirty(nullptr);
+    canvas.clear();
+    BOOST_CHECK_EQUAL(region.rects().size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_pixel_rows )
+{
+    using namespace sdlpp;
+    Bpp4Surface canvas(7, 5, SDL_PIXELFORMAT_ARGB8888);
+    std::uint32_t n = 0;
+    for (auto row : canvas.rows()) {
+        BOOST_CHECK_EQUAL(row.size(), 7);
+        for (auto& p : row) p = n++;
+    }
+    BOOST_CHECK_EQUAL(n, 35u);
+    BOOST_CHECK_EQUAL(canvas.getPixel(3, 2), 17u);
+    BOOST_CHECK_EQUAL(canvas.row(4)[6], 34u);
+
+    Bpp3Surface rgb24(5, 3, SDL_PIXELFORMAT_RGB24);
+    BOOST_CHECK_EQUAL(rgb24.rows()[2].size(), 15);
+
+    SDL_SetSurfaceBlendMode(canvas.get(), SDL_BLENDMODE_ADD);
+    SDL_SetSurfaceAlphaMod(canvas.get(), 10);
+    SDL_SetSurfaceColorMod(canvas.get(), 1, 2, 3);
+    {
+        Surface swapped = canvas.convert(SDL_PIXELFORMAT_ABGR8888);
+        SDL_BlendMode mode;
+        std::uint8_t red, green, blue, alpha;
+        SDL_GetSurfaceBlendMode(swapped.get(), &mode);
+        SDL_GetSurfaceAlphaMod(swapped.get(), &alpha);
+        SDL_GetSurfaceColorMod(swapped.get(), &red, &green, &blue);
+        BOOST_CHECK_EQUAL(mode, SDL_BLENDMODE_ADD);
+        BOOST_CHECK_EQUAL(int(alpha), 10);
+        BOOST_CHECK_EQUAL(int(red), 1);
+        BOOST_CHECK_EQUAL(int(green), 2);
+        BOOST_CHECK_EQUAL(int(blue), 3);
+    }
+
+    SDL_SetSurfaceRLE(canvas.get(), 1);
+    {
+        SurfaceLock lock(canvas);
+        BOOST_CHECK_EQUAL(lock.rows<std::uint32_t>()[1][0], 7u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_render_batch )
+{
+    using namespace sdlpp;
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    auto sdl = Initializer().video().acquire();
+    auto window = sdl.createWindow("batch", Rectangle(64, 64),
+                                   WindowMode().hide());
+    Renderer renderer(window.getRenderer());
+
+    // two interleaved colors: one color change and one call per color
+    RenderBatch sorted(renderer, RenderBatch::Order::State);
+    for (int i = 0; i < 100; i++) {
+        sorted.setDrawColor(i % 2 ? Color::Red : Color::Blue);
+        sorted.drawPoint(Position(i % 64, i / 64));
+    }
+    BOOST_CHECK_EQUAL(sorted.size(), 100u);
+    BOOST_CHECK_EQUAL(sorted.flush(), 4u);
+    BOOST_CHECK_EQUAL(sorted.size(), 0u);
+    BOOST_CHECK_EQUAL(renderer.stats().issued, 2u);
+    BOOST_CHECK_EQUAL(renderer.stats().elided, 0u);
+
+    // the renderer knows the batch left Red, the last color drawn
+    renderer.setDrawColor(Color::Red);
+    BOOST_CHECK_EQUAL(renderer.stats().elided, 1u);
+    renderer.setDrawColor(Color::White);
+    BOOST_CHECK_EQUAL(renderer.stats().issued, 3u);
+
+    // in order, a connected path is one polyline, a gap starts another
+    RenderBatch batch(renderer);
+    batch.drawLine(Position(0, 0), Position(10, 0));
+    batch.drawLine(Position(10, 0), Position(10, 10));
+    batch.drawLine(Position(20, 20), Position(30, 30));
+    batch.fillRectangle(Rectangle(4, 4, Position(1, 1)));
+    batch.fillRectangle(Rectangle(4, 4, Position(9, 9)));
+    BOOST_CHECK_EQUAL(batch.flush(), 4u);
+
+    // batched copies draw the pixels direct copies draw, including ones
+    // whose source leaves the texture and can not be geometry
+    Bpp4Surface tile(8, 8, SDL_PIXELFORMAT_ARGB8888);
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            tile.setPixel(x, y, 0xff000040 | x * 30 << 16 | y * 30 << 8);
+        }
+    }
+    OffscreenTarget direct(64, 64), batched(64, 64);
+    Texture directTile(direct.renderer(), tile);
+    Texture batchedTile(batched.renderer(), tile);
+    RenderBatch copies(batched.renderer());
+    const Rectangle src[] = {
+        Rectangle(8, 8, Position(0, 0)), Rectangle(4, 4, Position(2, 2)),
+        Rectangle(4, 4, Position(6, 6))
+    };
+    const Rectangle dest[] = {
+        Rectangle(8, 8, Position(0, 0)), Rectangle(8, 8, Position(20, 10)),
+        Rectangle(4, 4, Position(5, 50)), Rectangle(16, 8, Position(40, 40))
+    };
+    for (int i = 0; i < 4; i++) {
+        const Rectangle *s = i < 3 ? &src[i] : nullptr;
+        direct.renderer().copy(directTile, s, &dest[i]);
+        copies.copy(batchedTile, s, &dest[i]);
+    }
+    // two geometry calls around the SDL_RenderCopy() one
+    BOOST_CHECK_EQUAL(copies.flush(), 3u);
+    int wrong = 0;
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            wrong += direct.canvas().getPixel(x, y) !=
+                     batched.canvas().getPixel(x, y);
+        }
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+    BOOST_CHECK(direct.canvas().getPixel(43, 43) != 0);
+
+    // blended joined lines stay separate, so the shared vertex is drawn
+    // twice like it is by two drawLine() calls
+    OffscreenTarget directLines(32, 32), batchedLines(32, 32);
+    SDL_SetRenderDrawBlendMode(directLines.renderer().get(),
+                               SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawBlendMode(batchedLines.renderer().get(),
+                               SDL_BLENDMODE_BLEND);
+    Color translucent(255, 255, 255, 128);
+    directLines.renderer().setDrawColor(translucent);
+    directLines.renderer().drawLine(Position(2, 2), Position(20, 2));
+    directLines.renderer().drawLine(Position(20, 2), Position(20, 20));
+    RenderBatch lines(batchedLines.renderer());
+    lines.setDrawColor(translucent);
+    lines.drawLine(Position(2, 2), Position(20, 2));
+    lines.drawLine(Position(20, 2), Position(20, 20));
+    BOOST_CHECK_EQUAL(lines.flush(), 3u);
+    wrong = 0;
+    for (int y = 0; y < 32; y++) {
+        for (int x = 0; x < 32; x++) {
+            wrong += directLines.canvas().getPixel(x, y) !=
+                     batchedLines.canvas().getPixel(x, y);
+        }
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+    BOOST_CHECK(directLines.canvas().getPixel(20, 2) !=
+                directLines.canvas().getPixel(10, 2));
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_state_cache )
+{
+    using namespace sdlpp;
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    auto sdl = Initializer().video().acquire();
+    auto window = sdl.createWindow("cache", Rectangle(64, 64),
+                                   WindowMode().hide());
+    Renderer renderer(window.getRenderer());
+
+    for (int i = 0; i < 100; i++) {
+        renderer.setDrawColor(Color(i / 50, 0, 0));
+        renderer.setTarget();
+    }
+    BOOST_CHECK_EQUAL(renderer.stats().issued, 2u);
+    BOOST_CHECK_EQUAL(renderer.stats().elided, 198u);
+    renderer.invalidate();
+    renderer.setDrawColor(Color(1, 0, 0));
+    BOOST_CHECK_EQUAL(renderer.stats().issued, 3u);
+
+    Bpp4Surface surface(8, 8, SDL_PIXELFORMAT_ARGB8888);
+    Texture texture(renderer, surface);
+    for (int i = 0; i < 10; i++) {
+        texture.setColorMod(Color::White);
+        texture.setAlphaMod(i < 5 ? 0x80 : 0xff);
+        texture.setBlendMode(BlendMode::Blend);
+    }
+    BOOST_CHECK_EQUAL(texture.stats().issued, 4u);
+    BOOST_CHECK_EQUAL(texture.stats().elided, 26u);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_texture_atlas )
+{
+    using namespace sdlpp;
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    auto sdl = Initializer().video().acquire();
+    auto window = sdl.createWindow("atlas", Rectangle(64, 64),
+                                   WindowMode().hide());
+    Renderer renderer(window.getRenderer());
+    TextureAtlas atlas(renderer, 128, 128);
+    BOOST_CHECK_THROW(TextureAtlas(renderer, 0, 128), error::RuntimeError);
+
+    std::vector<AtlasRegion> regions;
+    for (int i = 0; i < 60; i++) {
+        Bpp4Surface s(8 + i % 5 * 6, 8 + i % 3 * 9, SDL_PIXELFORMAT_ARGB8888);
+        regions.push_back(atlas.insert(s));
+    }
+    auto check = [&](size_t from) {
+        for (size_t i = from; i < regions.size(); i++) {
+            Rectangle a = atlas.rect(regions[i]);
+            BOOST_CHECK_EQUAL(a.w, 8 + (int)i % 5 * 6);
+            BOOST_CHECK_EQUAL(a.h, 8 + (int)i % 3 * 9);
+            BOOST_CHECK(a.x >= 0 && a.y >= 0 && a.x + a.w <= 128 &&
+                        a.y + a.h <= 128);
+            for (size_t j = from; j < i; j++) {
+                Rectangle b = atlas.rect(regions[j]);
+                if (&atlas.texture(regions[i]) != &atlas.texture(regions[j])) {
+                    continue;
+                }
+                BOOST_CHECK(a.x + a.w < b.x || b.x + b.w < a.x ||
+                            a.y + a.h < b.y || b.y + b.h < a.y);
+            }
+        }
+    };
+    check(0);
+    std::size_t pages = atlas.pages();
+    BOOST_CHECK(pages >= 2);
+    BOOST_CHECK(atlas.occupancy() > 0.5);
+
+    for (int i = 0; i < 30; i++) atlas.erase(regions[i]);
+    BOOST_CHECK_THROW(atlas.rect(regions[0]), error::RuntimeError);
+    atlas.repack();
+    check(30);
+    BOOST_CHECK(atlas.pages() < pages);
+
+    Bpp4Surface small(4, 4, SDL_PIXELFORMAT_ARGB8888);
+    AtlasRegion reused = atlas.insert(small);
+    BOOST_CHECK(reused.id < 30);
+    BOOST_CHECK_EQUAL(atlas.rect(reused).w, 4);
+    check(30);
+
+    Bpp4Surface huge(200, 8, SDL_PIXELFORMAT_ARGB8888);
+    BOOST_CHECK_THROW(atlas.insert(huge), TextureAtlas::TooLarge);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_streaming_texture )
+{
+    using namespace sdlpp;
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    auto sdl = Initializer().video().acquire();
+    auto window = sdl.createWindow("streaming", Rectangle(64, 64),
+                                   WindowMode().hide());
+    Renderer renderer(window.getRenderer());
+    auto texture = renderer.spawnStreaming(32, 16);
+    {
+        Rectangle part(8, 4, Position(2, 3));
+        auto lock = texture.lock(&part);
+        auto& canvas = lock.canvas();
+        BOOST_CHECK_EQUAL(canvas.width(), 8);
+        BOOST_CHECK_EQUAL(canvas.height(), 4);
+        canvas.setDrawColor(Color::Red);
+        canvas.clear();
+        BOOST_CHECK_EQUAL(canvas.getPixel(7, 3), 0xffff0000u);
+    }
+
+    Bpp4Surface frame(32, 16, DEFAULT_PIXEL_FORMAT);
+    DirtyRegion dirty;
+    frame.trackDirty(&dirty);
+    frame.setDrawColor(Color::Blue);
+    frame.fillRectangle(Rectangle(4, 4, Position(0, 0)));
+    texture.update(frame, dirty);
+    texture.update(frame);
+
+    // rectangles hanging off the surface only copy the part inside it
+    OffscreenTarget target(32, 16);
+    auto shown = target.renderer().spawnStreaming(32, 16);
+    frame.setDrawColor(Color::Red);
+    frame.clear();
+    shown.update(frame);
+    frame.setDrawColor(Color::Green);
+    frame.clear();
+    Rectangle corner(8, 8, Position(-4, -4)), edge(8, 8, Position(28, 12));
+    Rectangle outside(8, 8, Position(40, 0));
+    shown.update(frame, &corner);
+    shown.update(frame, &edge);
+    shown.update(frame, &outside);
+    target.renderer().copy(shown);
+    target.flush();
+    std::uint32_t green = frame.getPixel(0, 0), red = 0xffff0000u;
+    BOOST_CHECK_EQUAL(target.canvas().getPixel(0, 0), green);
+    BOOST_CHECK_EQUAL(target.canvas().getPixel(3, 3), green);
+    BOOST_CHECK_EQUAL(target.canvas().getPixel(4, 4), red);
+    BOOST_CHECK_EQUAL(target.canvas().getPixel(31, 15), green);
+    BOOST_CHECK_EQUAL(target.canvas().getPixel(27, 15), red);
+
+    Bpp4Surface wrong(16, 16, DEFAULT_PIXEL_FORMAT);
+    try {
+        texture.update(wrong);
+        BOOST_ERROR("a 16x16 surface updated a 32x16 texture");
+    } catch (const error::RuntimeError& e) {
+        BOOST_CHECK(std::string(e.what()).find("16x16") != std::string::npos);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_image_loader )
+{
+    using namespace sdlpp;
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    auto sdl = Initializer().video().acquire();
+    auto window = sdl.createWindow("loader", Rectangle(64, 64),
+                                   WindowMode().hide());
+    Renderer renderer(window.getRenderer());
+
+    const char *path = "sdlpp_loader_test.bmp";
+    Bpp4Surface image(5, 3, SDL_PIXELFORMAT_ARGB8888);
+    BOOST_REQUIRE(SDL_SaveBMP(image.get(), path) == 0);
+
+    ThreadPool pool(2);
+    ImageLoader loader(pool, SDL_PIXELFORMAT_ABGR8888);
+    auto decoded = loader.decode(path);
+    auto missing = loader.decode("sdlpp_no_such_image.bmp");
+
+    int surfaces = 0, textures = 0, failures = 0;
+    for (int i = 0; i < 4; i++) {
+        loader.load(path, [&](Surface& s) {
+            BOOST_CHECK_EQUAL(s.width(), 5);
+            BOOST_CHECK_EQUAL(s.format(), SDL_PIXELFORMAT_ABGR8888);
+            surfaces++;
+        });
+        loader.load(path, renderer, [&](Texture&) { textures++; });
+    }
+    loader.load("sdlpp_no_such_image.bmp", [](Surface&) {},
+                [&](const std::string&) { failures++; });
+    BOOST_CHECK_EQUAL(loader.pending(), 9u);
+
+    // a zero budget still makes progress, one callback per call
+    while (loader.pending()) {
+        auto before = loader.pending();
+        auto n = loader.dispatch(std::chrono::microseconds(0));
+        BOOST_CHECK(n <= 1 && loader.pending() == before - n);
+    }
+    BOOST_CHECK_EQUAL(surfaces, 4);
+    BOOST_CHECK_EQUAL(textures, 4);
+    BOOST_CHECK_EQUAL(failures, 1);
+    BOOST_CHECK_EQUAL(decoded.get().height(), 3);
+    BOOST_CHECK_THROW(missing.get(), Surface::LoadFailure);
+    std::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_pack_file )
+{
+    using namespace sdlpp;
+    const char *image = "sdlpp_pack_test.bmp", *path = "sdlpp_pack_test.pak";
+    Bpp4Surface s(7, 2, SDL_PIXELFORMAT_ARGB8888);
+    BOOST_REQUIRE(SDL_SaveBMP(s.get(), image) == 0);
+
+    const char text[] = "hello";
+    PackWriter writer;
+    MemoryRegion hello = { text, 5 };
+    writer.add("hello.txt", hello);
+    writer.addFile("images/s.bmp", image);
+    writer.write(path);
+
+    {
+        PackFile pack(path);
+        BOOST_CHECK_EQUAL(pack.names().size(), 2u);
+        BOOST_CHECK(pack.contains("hello.txt") && !pack.contains("hello"));
+        MemoryRegion r = pack.get("hello.txt");
+        BOOST_CHECK_EQUAL(r.size, 5u);
+        BOOST_CHECK(memcmp(r.data, text, 5) == 0);
+        BOOST_CHECK_EQUAL((uintptr_t)r.data % 16, 0u);
+        BOOST_CHECK_EQUAL(pack.loadIMG("images/s.bmp").width(), 7);
+        BOOST_CHECK_THROW(pack.get("missing"), PackFile::NotFound);
+        BOOST_CHECK_THROW(pack.loadIMG("hello.txt"), Surface::LoadFailure);
+    }
+    if (sizeof(std::size_t) > sizeof(int)) {
+        // refused before a byte is read
+        MemoryRegion huge = { text, (std::size_t)INT_MAX + 1 };
+        BOOST_CHECK_THROW(Surface::loadBMP(huge), error::RuntimeError);
+        BOOST_CHECK_THROW(Surface::loadIMG(huge), error::RuntimeError);
+    }
+
+    BOOST_CHECK_THROW(PackFile pack(image), PackFile::FormatError);
+    BOOST_CHECK_THROW(MappedFile f("sdlpp_no_such_file"),
+                      MappedFile::OpenFailure);
+    const char *nowhere = "sdlpp_no_such_dir/test.pack";
+    try {
+        writer.write(nowhere);
+        BOOST_ERROR("wrote into a missing directory");
+    } catch (const error::RuntimeError& e) {
+        BOOST_CHECK(std::string(e.what()).find(nowhere) != std::string::npos);
+    }
+    std::remove(image);
+    std::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_surface_cache )
+{
+    using namespace sdlpp;
+    const char *image = "sdlpp_cache_test.bmp";
+    Bpp4Surface s(6, 4, SDL_PIXELFORMAT_ARGB8888);
+    s.setPixel(5, 3, 0xff102030);
+    BOOST_REQUIRE(SDL_SaveBMP(s.get(), image) == 0);
+
+    SurfaceCache cache(".", SDL_PIXELFORMAT_ABGR8888);
+    CachedSurface first = cache.load(image);
+    CachedSurface second = cache.load(image);
+    BOOST_CHECK(!first.mapped() && second.mapped());
+    BOOST_CHECK_EQUAL(cache.misses(), 1u);
+    BOOST_CHECK_EQUAL(cache.hits(), 1u);
+    BOOST_CHECK_EQUAL(second.surface().format(), SDL_PIXELFORMAT_ABGR8888);
+    BOOST_CHECK_EQUAL(second.surface().width(), 6);
+    auto rows = second.surface().rows<std::uint32_t>();
+    BOOST_CHECK_EQUAL(rows[3][5], 0xff302010u);
+    // mapped copy on write, the cache file does not change
+    rows[3][5] = 0;
+    BOOST_CHECK_EQUAL(cache.load(image).surface().rows<std::uint32_t>()[3][5],
+                      0xff302010u);
+    // the mapping moves along with the surface, with the pixel written
+    CachedSurface moved(std::move(second));
+    BOOST_CHECK(moved.mapped());
+    BOOST_CHECK_EQUAL(moved.surface().rows<std::uint32_t>()[3][5], 0u);
+    std::remove(cache.entry(MappedFile(image).region()).c_str());
+    std::remove(image);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_event_storage )
+{
+    using namespace sdlpp;
+    using namespace sdlpp::event;
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    auto sdl = Initializer().video().acquire();
+    SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+
+    EventData data;
+    BOOST_CHECK_THROW(data.type(), EventHandler::DereferenceFailure);
+    SDL_Event e = {};
+    e.type = SDL_KEYDOWN;
+    e.key.timestamp = 42;
+    e.key.keysym.sym = SDLK_a;
+    SDL_PushEvent(&e);
+    BOOST_REQUIRE(poll(data));
+    BOOST_CHECK(!poll(data));
+    BOOST_CHECK(data.type() == EventType::Keyboard);
+
+    EventHandler kept = data.slice();
+    EventHandler moved(std::move(kept));
+    BOOST_CHECK_EQUAL(moved.timestamp(), 42u);
+    BOOST_CHECK_EQUAL(moved.acquire<EventType::Keyboard>().sym(), SDLK_a);
+    BOOST_CHECK_THROW(kept.timestamp(), EventHandler::DereferenceFailure);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_event_batch )
+{
+    using namespace sdlpp;
+    using namespace sdlpp::event;
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    auto sdl = Initializer().video().acquire();
+    SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+
+    for (int i = 0; i < 10; i++) {
+        SDL_Event e = {};
+        e.type = i % 2 ? SDL_KEYDOWN : SDL_KEYUP;
+        e.key.state = i % 2 ? SDL_PRESSED : SDL_RELEASED;
+        e.key.keysym.sym = SDLK_a + i;
+        SDL_PushEvent(&e);
+    }
+    EventBatch<4> batch;
+    std::vector<SDL_Keycode> keys;
+    while (batch.drain()) {
+        BOOST_CHECK(batch.size() <= 4);
+        batch.each<EventType::Keyboard>([&](const Event<EventType::Keyboard>& k) {
+            if (k.pressed()) keys.push_back(k.sym());
+        });
+    }
+    BOOST_CHECK_EQUAL(keys.size(), 5u);
+    BOOST_CHECK_EQUAL(keys.back(), SDLK_a + 9);
+    BOOST_CHECK(batch.empty() && batch.begin() == batch.end());
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_event_dispatch )
+{
+    using namespace sdlpp;
+    using namespace sdlpp::event;
+    SDL_Event e = {};
+    int wheel = 0, buttons = 0, quits = 0;
+    auto dispatch = makeDispatcher(
+        [&](const Event<EventType::MouseWheel>& w) { wheel += w.y(); },
+        [&](const Event<EventType::MouseButton>& b) { buttons += b.button(); },
+        [&](const Event<EventType::Quit>&) { quits++; });
+
+    e.type = SDL_MOUSEWHEEL;
+    e.wheel.y = 3;
+    BOOST_CHECK(dispatch(e));
+    e.type = SDL_MOUSEBUTTONDOWN;
+    e.button.button = SDL_BUTTON_RIGHT;
+    BOOST_CHECK(dispatch(e));
+    e.type = SDL_QUIT;
+    BOOST_CHECK(dispatch(e));
+    // not handled, and no longer taken for a window event
+    e.type = SDL_KEYDOWN;
+    BOOST_CHECK(!dispatch(e));
+    e.type = SDL_CLIPBOARDUPDATE;
+    BOOST_CHECK(typeOf(e) == EventType::Unknown);
+    BOOST_CHECK(!dispatch(e));
+    e.type = SDL_USEREVENT + 1;
+    BOOST_CHECK(typeOf(e) == EventType::User);
+
+    BOOST_CHECK_EQUAL(wheel, 3);
+    BOOST_CHECK_EQUAL(buttons, SDL_BUTTON_RIGHT);
+    BOOST_CHECK_EQUAL(quits, 1);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_message_queue )
+{
+    using namespace sdlpp;
+    using namespace sdlpp::event;
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    auto sdl = Initializer().video().acquire();
+    SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+
+    MessageQueue<std::unique_ptr<int>> queue;
+    const int producers = 4, each = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < producers; t++) {
+        threads.push_back(std::thread([&queue, t]() {
+            for (int i = 0; i < each; i++) {
+                queue.push(std::unique_ptr<int>(new int(t * each + i)));
+            }
+        }));
+    }
+
+    std::vector<bool> seen(producers * each);
+    int received = 0, wakeups = 0;
+    EventData data;
+    while (received < producers * each) {
+        wait(data);
+        if (!queue.wakes(*data.get())) continue;
+        wakeups++;
+        received += queue.drain([&](std::unique_ptr<int>& m) {
+            seen[*m] = true;
+        });
+    }
+    for (auto& t : threads) t.join();
+    BOOST_CHECK(std::find(seen.begin(), seen.end(), false) == seen.end());
+    BOOST_CHECK(wakeups >= 1 && wakeups <= received);
+    BOOST_CHECK_EQUAL(queue.drain([](std::unique_ptr<int>&) {}), 0u);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_frame_loop )
+{
+    using namespace sdlpp;
+    int frames = 0;
+    double time = 0, minAlpha = 1, maxAlpha = 0;
+    FrameLoop* self = nullptr;
+    FrameLoop loop(
+        [&]() { if (++frames == 20) self->stop(); },
+        [&](double dt) { time += dt; },
+        [&](double alpha) {
+            minAlpha = std::min(minAlpha, alpha);
+            maxAlpha = std::max(maxAlpha, alpha);
+        },
+        1000, 100);
+    self = &loop;
+
+    auto start = SDL_GetPerformanceCounter();
+    loop.run();
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) /
+                     SDL_GetPerformanceFrequency();
+
+    // 19 paced periods of 10ms, updates follow the clock at 1kHz
+    BOOST_CHECK_EQUAL(loop.stats().frames, 20u);
+    BOOST_CHECK(seconds >= 0.19);
+    BOOST_CHECK_CLOSE(time, loop.stats().updates * 0.001, 1e-6);
+    BOOST_CHECK(time <= seconds + 1e-3);
+    BOOST_CHECK(loop.stats().updates + loop.stats().droppedUpdates >= 170u);
+    BOOST_CHECK(minAlpha >= 0 && maxAlpha < 1);
+    BOOST_CHECK(loop.stats().worst >= loop.stats().last &&
+                loop.stats().average > 0.005);
+
+    auto nothing = [](double) {};
+    BOOST_CHECK_THROW(FrameLoop([]() {}, nothing, nothing, 0),
+                      error::RuntimeError);
+    BOOST_CHECK_THROW(FrameLoop(nullptr, nullptr, nothing),
+                      error::RuntimeError);
+    BOOST_CHECK_THROW(FrameLoop(nullptr, nothing, nullptr),
+                      error::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_profile )
+{
+    using namespace sdlpp;
+    profile::clear();
+    {
+        profile::Zone zone("outer \"quoted\"");
+        std::thread([]() { profile::Zone zone("worker"); }).join();
+    }
+    profile::count(profile::Counter::DrawCalls, 3);
+    int texture = 0;
+    profile::texture(&texture);
+    profile::texture(&texture);
+    profile::frame();
+
+    std::ostringstream out;
+    profile::writeChromeTrace(out);
+    std::string json = out.str();
+    BOOST_CHECK(json.find("\"name\":\"outer \\\"quoted\\\"\",\"ph\":\"X\"") !=
+                std::string::npos);
+    BOOST_CHECK(json.find("\"name\":\"worker\"") != std::string::npos);
+    auto tid = [&](const char* name) {
+        size_t at = json.find("\"tid\":", json.find(name));
+        return json.substr(at, json.find('}', at) - at);
+    };
+    BOOST_CHECK(tid("outer") != tid("worker"));
+    BOOST_CHECK(json.find("\"drawCalls\":3,\"textureSwitches\":1") !=
+                std::string::npos);
+
+    // counts of all threads add up, a finished thread's ring is reused
+    profile::clear();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 4; i++) {
+        workers.push_back(std::thread([]() {
+            for (int j = 0; j < 1000; j++) {
+                profile::count(profile::Counter::Blits, 1);
+            }
+        }));
+    }
+    for (auto& t : workers) t.join();
+    std::thread([]() { profile::Zone zone("first"); }).join();
+    std::thread([]() { profile::Zone zone("second"); }).join();
+    profile::frame();
+    std::ostringstream threads;
+    profile::writeChromeTrace(threads);
+    json = threads.str();
+    BOOST_CHECK(json.find("\"blits\":4000") != std::string::npos);
+    BOOST_CHECK(json.find("\"name\":\"first\"") != std::string::npos);
+    BOOST_CHECK(tid("first") != tid("second"));
+
+    profile::clear();
+    std::ostringstream empty;
+    profile::writeChromeTrace(empty);
+    BOOST_CHECK_EQUAL(empty.str(), "{\"traceEvents\":[\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_offscreen_target )
+{
+    using namespace sdlpp;
+    // no SDL_Init() and no window
+    OffscreenTarget target(32, 16);
+    target.renderer().setDrawColor(Color::Black);
+    target.renderer().clear();
+    target.renderer().setDrawColor(Color::Red);
+    target.renderer().fillRectangle(Rectangle(8, 8, Position(4, 4)));
+    Bpp4Surface& canvas = target.canvas();
+    BOOST_CHECK_EQUAL(canvas.getPixel(5, 5),
+                      Color(Color::Red).mapRGBA(canvas.getFormat()));
+    BOOST_CHECK_EQUAL(canvas.getPixel(11, 11),
+                      Color(Color::Red).mapRGBA(canvas.getFormat()));
+    BOOST_CHECK_EQUAL(canvas.getPixel(12, 12),
+                      Color(Color::Black).mapRGBA(canvas.getFormat()));
+
+    std::vector<std::uint8_t> png;
+    target.encodePNG(png);
+    BOOST_REQUIRE(!png.empty());
+    Surface decoded = Surface::loadIMG(MemoryRegion{ png.data(), png.size() });
+    Bpp4Surface image(32, 16, SDL_PIXELFORMAT_ARGB8888);
+    image.blit(decoded, nullptr, nullptr);
+    BOOST_CHECK_EQUAL(image.width(), target.width());
+    BOOST_CHECK_EQUAL(image.getPixel(5, 5), Color(Color::Red).mapRGBA(image.getFormat()));
+    BOOST_CHECK_EQUAL(image.getPixel(20, 5), Color(Color::Black).mapRGBA(image.getFormat()));
+
+    // encoding again replaces the content
+    target.encodePNG(png);
+    BOOST_CHECK(png == target.encodePNG());
+}
+
+BOOST_AUTO_TEST_CASE( sdlpp_object_pool )
+{
+    using namespace sdlpp;
+    // idle room for the 32x32 and 64x64 surfaces but not also the 16x16
+    SurfacePool surfaces((32 * 32 + 64 * 64) * 4);
+    SDL_Surface *reused;
+    {
+        // given back in reverse order, a first
+        auto c = surfaces.acquire(64, 64);
+        auto b = surfaces.acquire(32, 32);
+        auto a = surfaces.acquire(16, 16);
+        reused = b->get();
+        DirtyRegion region;
+        b->trackDirty(&region);
+        SDL_SetSurfaceBlendMode(reused, SDL_BLENDMODE_ADD);
+        SDL_SetSurfaceAlphaMod(reused, 10);
+        SDL_SetSurfaceColorMod(reused, 1, 2, 3);
+    }
+    BOOST_CHECK_EQUAL(surfaces.misses(), 3u);
+    BOOST_CHECK_EQUAL(surfaces.idleBytes(), (32 * 32 + 64 * 64) * 4u);
+    {
+        auto b = surfaces.acquire(32, 32);
+        BOOST_CHECK_EQUAL(b->get(), reused);
+        BOOST_CHECK_EQUAL(surfaces.hits(), 1u);
+        SDL_BlendMode mode;
+        Uint8 red, green, blue, alpha;
+        SDL_GetSurfaceBlendMode(reused, &mode);
+        SDL_GetSurfaceAlphaMod(reused, &alpha);
+        SDL_GetSurfaceColorMod(reused, &red, &green, &blue);
+        BOOST_CHECK_EQUAL(mode, SDL_BLENDMODE_BLEND);
+        BOOST_CHECK((red & green & blue & alpha) == 0xff);
+        Bpp4Surface src(32, 32, SDL_PIXELFORMAT_ARGB8888);
+        b->blit(src);   // dirty tracking was reset, nothing to record
+        auto a = surfaces.acquire(16, 16);
+        BOOST_CHECK_EQUAL(surfaces.misses(), 4u);
+        auto other = surfaces.acquire(32, 32, SDL_PIXELFORMAT_ABGR8888);
+        BOOST_CHECK(other->get() != reused);
+    }
+    surfaces.clear();
+    BOOST_CHECK_EQUAL(surfaces.idleBytes(), 0u);
+
+    // canvases come back drawable and as new, plain surfaces stay apart
+    {
+        auto canvas = surfaces.acquireBpp4(32, 32);
+        reused = canvas->get();
+        Rectangle corner(4, 4, Position(0, 0));
+        canvas->setClipRect(&corner);
+        canvas->setBlendMode(BlendMode::Add);
+        canvas->setDrawColor(Color::Red);
+        canvas->clear();
+    }
+    {
+        auto plain = surfaces.acquire(32, 32);
+        BOOST_CHECK(plain->get() != reused);
+        auto canvas = surfaces.acquireBpp4(32, 32);
+        BOOST_CHECK_EQUAL(canvas->get(), reused);
+        BOOST_CHECK_EQUAL(canvas->getClipRect().w, 32);
+        BOOST_CHECK_EQUAL(canvas->getBlendMode(), BlendMode::None);
+        canvas->clear();
+        BOOST_CHECK_EQUAL(canvas->getPixel(31, 31), 0u);
+    }
+    BOOST_CHECK_THROW(surfaces.acquireBpp4(8, 8, SDL_PIXELFORMAT_RGB565),
+                      error::RuntimeError);
+
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    auto sdl = Initializer().video().acquire();
+    auto window = sdl.createWindow("pool", Rectangle(64, 64),
+                                   WindowMode().hide());
+    Renderer renderer(window.getRenderer());
+    TexturePool textures(renderer);
+    SDL_Texture *target;
+    {
+        auto t = textures.acquireTarget(64, 64);
+        renderer.setTarget(&*t);
+        renderer.setTarget();
+        t->setBlendMode(BlendMode::Add);
+        target = t->get();
+    }
+    auto t = textures.acquireTarget(64, 64);
+    BOOST_CHECK_EQUAL(t->get(), target);
+    SDL_BlendMode mode;
+    SDL_GetTextureBlendMode(t->get(), &mode);
+    BOOST_CHECK_EQUAL(mode, SDL_BLENDMODE_NONE);
+    auto s = textures.acquireStreaming(64, 64);
+    BOOST_CHECK(s->get() != target);
+    s->lock().canvas().setPixel(0, 0, 0);
+}
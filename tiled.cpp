@@ -0,0 +1,325 @@
+/*!
+ * @section LICENSE
+ * Copyright (c) 2014 Hao Fei <mrfeihao@gmail.com>
+ *
+ * This file is part of libsdlpp.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ * tiled, multi-threaded rasterization of Canvas drawing
+ */
+
+#define SDLPP_PRIVATE
+#include "sdlpp.hpp"
+#include <atomic>
+
+using namespace std;
+
+namespace sdlpp {
+
+namespace {
+    //! intersection of a and b, w or h is not positive when empty
+    Rectangle intersect(const Rectangle& a, const Rectangle& b)
+    {
+        int x0 = max(a.x, b.x), y0 = max(a.y, b.y);
+        int x1 = min(a.x + a.w, b.x + b.w), y1 = min(a.y + a.h, b.y + b.h);
+        return Rectangle(x1 - x0, y1 - y0, Position(x0, y0));
+    }
+
+    //! inclusive rectangle from two corners in any order, grown by margin
+    void corners(const Position& a, const Position& b, int margin,
+                 int& xa, int& ya, int& xb, int& yb)
+    {
+        xa = min(a.x, b.x) - margin;
+        ya = min(a.y, b.y) - margin;
+        xb = max(a.x, b.x) + margin;
+        yb = max(a.y, b.y) + margin;
+    }
+
+    void corners(const Rectangle& r, int margin,
+                 int& xa, int& ya, int& xb, int& yb)
+    {
+        corners(Position(r.x, r.y), Position(r.x + r.w, r.y + r.h), margin,
+                xa, ya, xb, yb);
+    }
+}
+
+TiledCanvas::TiledCanvas(Bpp4Surface& t, ThreadPool& p, int tw, int th)
+    : target(t), pool(p), tileWidth(tw > 0 ? tw : t.width()),
+      tileHeight(th > 0 ? th : 16),
+      color(0, 0, 0, 0), mode(BlendMode::None),
+      clip(t.width(), t.height(), Position(0, 0)), dirty(nullptr)
+{
+}
+
+TiledCanvas::Command *
+TiledCanvas::record(Command::Op op, int xa, int ya, int xb, int yb)
+{
+    Rectangle box = intersect(clip,
+            Rectangle(xb - xa + 1, yb - ya + 1, Position(xa, ya)));
+    if (box.w <= 0 || box.h <= 0) {
+        return nullptr;
+    }
+    Command c = { op, color, mode, clip, box, Position(), Position(),
+                  Rectangle(), 0, 0 };
+    commands.push_back(c);
+    if (dirty) {
+        dirty->add(box);
+    }
+    return &commands.back();
+}
+
+void TiledCanvas::trackDirty(DirtyRegion *region)
+{
+    dirty = region;
+}
+
+void TiledCanvas::setDrawColor(Color c)
+{
+    color = c;
+}
+
+void TiledCanvas::setBlendMode(BlendMode::type m)
+{
+    mode = m;
+}
+
+bool TiledCanvas::setClipRect(const Rectangle* rect)
+{
+    clip = Rectangle(target.width(), target.height(), Position(0, 0));
+    if (rect) {
+        clip = intersect(clip, *rect);
+    }
+    return clip.w > 0 && clip.h > 0;
+}
+
+void TiledCanvas::clear()
+{
+    record(Command::Clear, clip.x, clip.y,
+           clip.x + clip.w - 1, clip.y + clip.h - 1);
+}
+
+void TiledCanvas::drawPoint(Position pos)
+{
+    Command *c = record(Command::Point, pos.x, pos.y, pos.x, pos.y);
+    if (c) c->a = pos;
+}
+
+void TiledCanvas::drawLine(Position a, Position b)
+{
+    int xa, ya, xb, yb;
+    corners(a, b, 0, xa, ya, xb, yb);
+    Command *c = record(Command::Line, xa, ya, xb, yb);
+    if (c) { c->a = a; c->b = b; }
+}
+
+void TiledCanvas::drawEllipse(Position center, Position radius)
+{
+    int xa, ya, xb, yb;
+    Position r(abs(radius.x), abs(radius.y));
+    corners(Position(center.x - r.x, center.y - r.y),
+            Position(center.x + r.x, center.y + r.y), 1, xa, ya, xb, yb);
+    Command *c = record(Command::Ellipse, xa, ya, xb, yb);
+    if (c) { c->a = center; c->b = radius; }
+}
+
+void TiledCanvas::fillEllipse(Position center, Position radius)
+{
+    int xa, ya, xb, yb;
+    Position r(abs(radius.x), abs(radius.y));
+    corners(Position(center.x - r.x, center.y - r.y),
+            Position(center.x + r.x, center.y + r.y), 1, xa, ya, xb, yb);
+    Command *c = record(Command::FillEllipse, xa, ya, xb, yb);
+    if (c) { c->a = center; c->b = radius; }
+}
+
+void TiledCanvas::drawEllipse(Rectangle rect)
+{
+    int xa, ya, xb, yb;
+    corners(rect, 1, xa, ya, xb, yb);
+    Command *c = record(Command::EllipseRect, xa, ya, xb, yb);
+    if (c) c->rect = rect;
+}
+
+void TiledCanvas::fillEllipse(Rectangle rect)
+{
+    int xa, ya, xb, yb;
+    corners(rect, 1, xa, ya, xb, yb);
+    Command *c = record(Command::FillEllipseRect, xa, ya, xb, yb);
+    if (c) c->rect = rect;
+}
+
+void TiledCanvas::drawRectangle(Rectangle rect)
+{
+    int xa, ya, xb, yb;
+    corners(rect, 1, xa, ya, xb, yb);
+    Command *c = record(Command::Rect, xa, ya, xb, yb);
+    if (c) c->rect = rect;
+}
+
+void TiledCanvas::fillRectangle(Rectangle rect)
+{
+    int xa, ya, xb, yb;
+    corners(rect, 1, xa, ya, xb, yb);
+    Command *c = record(Command::FillRect, xa, ya, xb, yb);
+    if (c) c->rect = rect;
+}
+
+void TiledCanvas::drawCircle(Position center, int radius)
+{
+    int xa, ya, xb, yb, r = abs(radius) + 1;
+    corners(center, center, r, xa, ya, xb, yb);
+    Command *c = record(Command::Circle, xa, ya, xb, yb);
+    if (c) { c->a = center; c->radius = radius; }
+}
+
+void TiledCanvas::fillCircle(Position center, int radius)
+{
+    int xa, ya, xb, yb, r = abs(radius) + 1;
+    corners(center, center, r, xa, ya, xb, yb);
+    Command *c = record(Command::FillCircle, xa, ya, xb, yb);
+    if (c) { c->a = center; c->radius = radius; }
+}
+
+void TiledCanvas::drawLineAA(Position a, Position b)
+{
+    int xa, ya, xb, yb;
+    corners(a, b, 2, xa, ya, xb, yb);
+    Command *c = record(Command::LineAA, xa, ya, xb, yb);
+    if (c) { c->a = a; c->b = b; }
+}
+
+void TiledCanvas::drawLineAA(Position a, Position b, double width)
+{
+    int xa, ya, xb, yb;
+    corners(a, b, (int)ceil(width / 2) + 2, xa, ya, xb, yb);
+    Command *c = record(Command::ThickLineAA, xa, ya, xb, yb);
+    if (c) { c->a = a; c->b = b; c->width = width; }
+}
+
+void TiledCanvas::drawCircleAA(Position center, int radius)
+{
+    int xa, ya, xb, yb, r = abs(radius) + 2;
+    corners(center, center, r, xa, ya, xb, yb);
+    Command *c = record(Command::CircleAA, xa, ya, xb, yb);
+    if (c) { c->a = center; c->radius = radius; }
+}
+
+void TiledCanvas::drawEllipseAA(Position center, Position radius)
+{
+    int a = abs(radius.x), b = abs(radius.y);
+    drawEllipseAA(Rectangle(2*a, 2*b, Position(center.x - a, center.y - b)));
+}
+
+void TiledCanvas::drawEllipseAA(Rectangle rect)
+{
+    int xa, ya, xb, yb;
+    corners(rect, 2, xa, ya, xb, yb);
+    Command *c = record(Command::EllipseRectAA, xa, ya, xb, yb);
+    if (c) c->rect = rect;
+}
+
+void TiledCanvas::replay(Bpp4View& view, const Command& c,
+                         const Rectangle& tile)
+{
+    Rectangle r = intersect(c.clip, tile);
+    view.setClipRect(&r);
+    view.setDrawColor(c.color);
+    view.setBlendMode(c.mode);
+    switch (c.op) {
+        case Command::Clear: view.clear(); break;
+        case Command::Point: view.drawPoint(c.a); break;
+        case Command::Line: view.drawLine(c.a, c.b); break;
+        case Command::Ellipse: view.drawEllipse(c.a, c.b); break;
+        case Command::FillEllipse: view.fillEllipse(c.a, c.b); break;
+        case Command::EllipseRect: view.drawEllipse(c.rect); break;
+        case Command::FillEllipseRect: view.fillEllipse(c.rect); break;
+        case Command::Rect: view.drawRectangle(c.rect); break;
+        case Command::FillRect: view.fillRectangle(c.rect); break;
+        case Command::Circle: view.drawCircle(c.a, c.radius); break;
+        case Command::FillCircle: view.fillCircle(c.a, c.radius); break;
+        case Command::LineAA: view.drawLineAA(c.a, c.b); break;
+        case Command::ThickLineAA: view.drawLineAA(c.a, c.b, c.width); break;
+        case Command::CircleAA: view.drawCircleAA(c.a, c.radius); break;
+        case Command::EllipseRectAA: view.drawEllipseAA(c.rect); break;
+    }
+}
+
+void TiledCanvas::flush()
+{
+    SDLPP_ZONE("TiledCanvas::flush");
+    if (commands.empty()) {
+        return;
+    }
+
+    // bin command indices to the tiles their boxes touch, in order
+    const int cols = (target.width() + tileWidth - 1) / tileWidth;
+    const int rows = (target.height() + tileHeight - 1) / tileHeight;
+    vector<vector<uint32_t>> bins(cols * rows);
+    for (size_t i = 0; i < commands.size(); i++) {
+        const Rectangle& b = commands[i].box;
+        int tx0 = b.x / tileWidth, tx1 = (b.x + b.w - 1) / tileWidth;
+        int ty0 = b.y / tileHeight, ty1 = (b.y + b.h - 1) / tileHeight;
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                bins[ty * cols + tx].push_back((uint32_t)i);
+            }
+        }
+    }
+
+    // every worker takes the next unclaimed tile until none is left
+    atomic<int> next(0);
+    auto work = [&]() {
+        SDLPP_ZONE("TiledCanvas::tiles");
+        Bpp4View view(target);
+        for (int t; (t = next++) < cols * rows; ) {
+            if (bins[t].empty()) continue;
+            Rectangle area(tileWidth, tileHeight,
+                    Position(t % cols * tileWidth, t / cols * tileHeight));
+            for (uint32_t i : bins[t]) {
+                replay(view, commands[i], area);
+            }
+        }
+    };
+
+    // a task of the pool waiting for the pool could wait forever
+    if (pool.isWorker()) {
+        work();
+        commands.clear();
+        return;
+    }
+
+    // join only our jobs, the pool may be running other tasks too
+    mutex lock;
+    condition_variable done;
+    unsigned remaining = pool.size();
+    for (unsigned i = 0; i < pool.size(); i++) {
+        pool.post([&]() {
+            work();
+            lock_guard<mutex> guard(lock);
+            if (--remaining == 0) done.notify_one();
+        });
+    }
+    unique_lock<mutex> guard(lock);
+    done.wait(guard, [&] { return remaining == 0; });
+    commands.clear();
+}
+
+} // end namespace sdlpp